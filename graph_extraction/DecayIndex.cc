@@ -0,0 +1,519 @@
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <memory>
+#include <queue>
+#include <functional>
+
+#include "DecayIndex.h"
+
+namespace {
+
+const char index_magic[8] = { 'D', 'C', 'Y', 'I', 'D', 'X', '2', '\0' };
+
+// posting lists are stored as the zigzag encoded first eid followed by
+// the gaps to the next ones, each as a base 128 varint.
+void put_varint(std::string &out, uint64_t x) {
+  while (x >= 0x80) { out.push_back(char(x | 0x80)); x >>= 7; }
+  out.push_back(char(x));
+}
+
+uint64_t get_varint(const std::string &in, size_t &pos) {
+  uint64_t x = 0;
+  for (int shift = 0; pos < in.size() && shift < 64; shift += 7) {
+    uint8_t b = in[pos++];
+    x |= uint64_t(b & 0x7f) << shift;
+    if (!(b & 0x80)) { return x; }
+  }
+  throw std::runtime_error("DecayIndex: corrupt posting list. ");
+}
+
+void encode_postings(const std::vector<int> &eids, std::string &out) {
+  if (eids.empty()) { return; }
+  int64_t first = eids[0];
+  put_varint(out, (uint64_t(first) << 1) ^ uint64_t(first >> 63));
+  for (size_t i = 1; i < eids.size(); ++i) {
+    put_varint(out, uint64_t(int64_t(eids[i]) - eids[i-1]));
+  }
+}
+
+void decode_postings(const std::string &in, size_t n, std::vector<int> &eids) {
+  eids.clear();
+  if (n == 0) { return; }
+  eids.reserve(n);
+  size_t pos = 0;
+  uint64_t z = get_varint(in, pos);
+  int64_t eid = int64_t(z >> 1) ^ -int64_t(z & 1);
+  eids.push_back(eid);
+  for (size_t i = 1; i < n; ++i) {
+    eid += get_varint(in, pos);
+    eids.push_back(eid);
+  }
+}
+
+// sorts and deduplicates `eids`.
+void sort_postings(std::vector<int> &eids) {
+  std::sort(eids.begin(), eids.end());
+  eids.erase(std::unique(eids.begin(), eids.end()), eids.end());
+}
+
+template <typename T>
+void write_pod(std::ostream &os, const T &x) {
+  os.write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+template <typename T>
+bool read_pod(std::istream &is, T &x) {
+  return bool(is.read(reinterpret_cast<char*>(&x), sizeof(T)));
+}
+
+// sequential reader of a run spilled by DecayIndexBuilder. a run is a
+// sequence of key length, key, number of eids, postings length and
+// postings, sorted by key.
+class RunReader {
+
+  public:
+    RunReader(const std::string &fname) : fin_(fname, std::ios::binary) {
+      if (!fin_.is_open()) {
+        throw std::runtime_error(
+            "RunReader::RunReader(): cannot open " + fname + ". ");
+      }
+    }
+
+    // load the next key and its eids. returns false at the end.
+    bool next() {
+      uint32_t key_len, n_eids;
+      uint64_t n_bytes;
+      if (!read_pod(fin_, key_len)) { return false; }
+      key_.resize(key_len);
+      fin_.read(&key_[0], key_len);
+      read_pod(fin_, n_eids);
+      read_pod(fin_, n_bytes);
+      bytes_.resize(n_bytes);
+      fin_.read(&bytes_[0], n_bytes);
+      if (!fin_) {
+        throw std::runtime_error("RunReader::next(): truncated run. ");
+      }
+      decode_postings(bytes_, n_eids, eids_);
+      return true;
+    }
+
+    const std::string& key() const { return key_; }
+    const std::vector<int>& eids() const { return eids_; }
+
+  private:
+    std::ifstream fin_;
+    std::string key_, bytes_;
+    std::vector<int> eids_;
+};
+
+}
+
+std::string decay_key(int mother, std::vector<int> daughters) {
+  std::sort(daughters.begin(), daughters.end());
+  std::string key = "d:" + std::to_string(mother) + "(";
+  for (size_t i = 0; i < daughters.size(); ++i) {
+    if (i) { key += " "; }
+    key += std::to_string(daughters[i]);
+  }
+  return key + ")";
+}
+
+std::string tree_signature(int mother, std::vector<std::string> daughters) {
+  if (daughters.empty()) { return std::to_string(mother); }
+  std::sort(daughters.begin(), daughters.end());
+  std::string sig = std::to_string(mother) + "(";
+  for (size_t i = 0; i < daughters.size(); ++i) {
+    if (i) { sig += " "; }
+    sig += daughters[i];
+  }
+  return sig + ")";
+}
+
+DecayIndexBuilder::DecayIndexBuilder(int max_tree_vertices,
+                                     size_t max_memory_bytes,
+                                     const std::string &spill_prefix)
+  : max_tree_vertices_(max_tree_vertices), n_events_(0),
+    max_memory_bytes_(max_memory_bytes), memory_bytes_(0),
+    spill_prefix_(spill_prefix) {
+  if (max_tree_vertices_ < 0) {
+    throw std::invalid_argument(
+        "DecayIndexBuilder::DecayIndexBuilder(): max_tree_vertices must "
+        "not be negative. ");
+  }
+}
+
+DecayIndexBuilder::~DecayIndexBuilder() { remove_runs(); }
+
+void DecayIndexBuilder::add_event(
+    int eid, int n_vertices,
+    const std::vector<int> &from_vertices,
+    const std::vector<int> &to_vertices,
+    const std::vector<int> &lund_id) {
+
+  if (from_vertices.size() != to_vertices.size() ||
+      lund_id.size() != size_t(n_vertices)) {
+    throw std::invalid_argument(
+        "DecayIndexBuilder::add_event(): inconsistent graph of eid " +
+        std::to_string(eid) + ". ");
+  }
+
+  // bucket the edges by mother
+  first_daughter_.assign(n_vertices+1, 0);
+  for (size_t i = 0; i < from_vertices.size(); ++i) {
+    int u = from_vertices[i], v = to_vertices[i];
+    if (u < 0 || u >= n_vertices || v < 0 || v >= n_vertices) {
+      throw std::invalid_argument(
+          "DecayIndexBuilder::add_event(): vertex out of range in eid " +
+          std::to_string(eid) + ". ");
+    }
+    ++first_daughter_[u+1];
+  }
+  for (int v = 0; v < n_vertices; ++v) {
+    first_daughter_[v+1] += first_daughter_[v];
+  }
+
+  daughters_.resize(from_vertices.size());
+  std::vector<int> pos(first_daughter_.begin(), first_daughter_.end()-1);
+  for (size_t i = 0; i < from_vertices.size(); ++i) {
+    daughters_[pos[from_vertices[i]]++] = to_vertices[i];
+  }
+
+  lund_id_ = lund_id;
+  add_event(eid, n_vertices);
+}
+
+void DecayIndexBuilder::add_event_csr(
+    int eid, int n_vertices,
+    const std::vector<int> &daulen,
+    const std::vector<int> &dauidx,
+    const std::vector<int> &lund_id) {
+
+  if (daulen.size() != size_t(n_vertices) ||
+      dauidx.size() != size_t(n_vertices) ||
+      lund_id.size() != size_t(n_vertices)) {
+    throw std::invalid_argument(
+        "DecayIndexBuilder::add_event_csr(): inconsistent graph of eid " +
+        std::to_string(eid) + ". ");
+  }
+
+  // same convention as extract_mcgraph: non-positive entries mean no
+  // daughters.
+  first_daughter_.assign(n_vertices+1, 0);
+  daughters_.clear();
+  for (int i = 0; i < n_vertices; ++i) {
+    if (daulen[i] > 0 && dauidx[i] > 0) {
+      if (dauidx[i] + daulen[i] > n_vertices) {
+        throw std::invalid_argument(
+            "DecayIndexBuilder::add_event_csr(): daughter out of range in "
+            "eid " + std::to_string(eid) + ". ");
+      }
+      for (int j = dauidx[i]; j < dauidx[i]+daulen[i]; ++j) {
+        daughters_.push_back(j);
+      }
+    }
+    first_daughter_[i+1] = daughters_.size();
+  }
+
+  lund_id_ = lund_id;
+  add_event(eid, n_vertices);
+}
+
+// add the keys of the graph held in first_daughter_, daughters_ and
+// lund_id_.
+void DecayIndexBuilder::add_event(int eid, int n_vertices) {
+
+  ++n_events_;
+
+  signatures_.assign(n_vertices, std::string());
+  tree_sizes_.assign(n_vertices, 0);
+  state_.assign(n_vertices, 0);
+
+  std::vector<int> daughter_lunds;
+  for (int v = 0; v < n_vertices; ++v) {
+    if (first_daughter_[v] == first_daughter_[v+1]) { continue; }
+
+    daughter_lunds.clear();
+    for (int k = first_daughter_[v]; k < first_daughter_[v+1]; ++k) {
+      daughter_lunds.push_back(lund_id_[daughters_[k]]);
+    }
+    add_key(decay_key(lund_id_[v], daughter_lunds), eid);
+
+    const std::string &sig = signature(v);
+    if (!sig.empty()) { add_key(tree_key(sig), eid); }
+  }
+
+  if (max_memory_bytes_ > 0 && memory_bytes_ > max_memory_bytes_) {
+    spill_run();
+  }
+}
+
+// tree signature of the subtree of `v`, or an empty string if it has
+// more than max_tree_vertices_ vertices.
+const std::string& DecayIndexBuilder::signature(int v) {
+
+  if (state_[v] == 2) { return signatures_[v]; }
+  if (state_[v] == 1) {
+    throw std::invalid_argument(
+        "DecayIndexBuilder::signature(): mc graph has a cycle. ");
+  }
+  state_[v] = 1;
+
+  int size = 1;
+  bool too_large = false;
+  std::vector<std::string> daughter_sigs;
+  for (int k = first_daughter_[v]; k < first_daughter_[v+1]; ++k) {
+    int d = daughters_[k];
+    const std::string &sig = signature(d);
+    size += tree_sizes_[d];
+    too_large |= sig.empty();
+    if (!too_large) { daughter_sigs.push_back(sig); }
+  }
+
+  tree_sizes_[v] = size;
+  if (!too_large && size <= max_tree_vertices_) {
+    signatures_[v] = tree_signature(lund_id_[v], daughter_sigs);
+  }
+  state_[v] = 2;
+  return signatures_[v];
+}
+
+void DecayIndexBuilder::add_key(const std::string &key, int eid) {
+  auto it = postings_.find(key);
+  if (it == postings_.end()) {
+    it = postings_.emplace(key, std::vector<int>()).first;
+    memory_bytes_ += key.size() + sizeof(std::string) +
+                     sizeof(std::vector<int>) + 4 * sizeof(void*);
+  }
+  std::vector<int> &eids = it->second;
+  if (eids.empty() || eids.back() != eid) {
+    eids.push_back(eid);
+    memory_bytes_ += sizeof(int);
+  }
+}
+
+// write the postings held in memory to a new run, sorted by key, and
+// empty them.
+void DecayIndexBuilder::spill_run() {
+
+  std::string fname = spill_prefix_ + ".run" + std::to_string(runs_.size());
+  std::ofstream fout(fname, std::ios::binary);
+  if (!fout.is_open()) {
+    throw std::runtime_error(
+        "DecayIndexBuilder::spill_run(): cannot open " + fname + ". ");
+  }
+  runs_.push_back(fname);
+
+  std::vector<std::pair<const std::string, std::vector<int>>*> keys;
+  keys.reserve(postings_.size());
+  for (auto &p : postings_) { keys.push_back(&p); }
+  std::sort(keys.begin(), keys.end(),
+      [] (const std::pair<const std::string, std::vector<int>> *a,
+          const std::pair<const std::string, std::vector<int>> *b) {
+        return a->first < b->first; });
+
+  std::string bytes;
+  for (auto *p : keys) {
+    sort_postings(p->second);
+    bytes.clear();
+    encode_postings(p->second, bytes);
+    write_pod(fout, uint32_t(p->first.size()));
+    fout << p->first;
+    write_pod(fout, uint32_t(p->second.size()));
+    write_pod(fout, uint64_t(bytes.size()));
+    fout << bytes;
+  }
+
+  fout.close();
+  if (!fout) {
+    throw std::runtime_error(
+        "DecayIndexBuilder::spill_run(): failed writing " + fname + ". ");
+  }
+
+  postings_.clear();
+  memory_bytes_ = 0;
+}
+
+void DecayIndexBuilder::remove_runs() {
+  for (const auto &fname : runs_) { std::remove(fname.c_str()); }
+  runs_.clear();
+}
+
+void DecayIndexBuilder::write(const std::string &fname) {
+
+  std::ofstream fout(fname, std::ios::binary);
+  if (!fout.is_open()) {
+    throw std::runtime_error(
+        "DecayIndexBuilder::write(): cannot open " + fname + ". ");
+  }
+
+  // the postings are written as the keys come in sorted order, behind
+  // a header that is filled in at the end.
+  DecayIndex::Header header;
+  std::memset(&header, 0, sizeof(header));
+  write_pod(fout, header);
+
+  std::vector<DecayIndex::Entry> entries;
+  std::string key_blob, bytes;
+  uint64_t offset = sizeof(DecayIndex::Header);
+  auto add = [&] (const std::string &key, std::vector<int> &eids) {
+    sort_postings(eids);
+    bytes.clear();
+    encode_postings(eids, bytes);
+    fout << bytes;
+
+    DecayIndex::Entry e;
+    e.key_offset = key_blob.size();
+    e.key_len = key.size();
+    e.postings_offset = offset;
+    e.postings_bytes = bytes.size();
+    e.n_eids = eids.size();
+    entries.push_back(e);
+
+    key_blob += key;
+    offset += bytes.size();
+  };
+
+  if (runs_.empty()) {
+
+    std::vector<std::pair<const std::string, std::vector<int>>*> keys;
+    keys.reserve(postings_.size());
+    for (auto &p : postings_) { keys.push_back(&p); }
+    std::sort(keys.begin(), keys.end(),
+        [] (const std::pair<const std::string, std::vector<int>> *a,
+            const std::pair<const std::string, std::vector<int>> *b) {
+          return a->first < b->first; });
+    for (auto *p : keys) { add(p->first, p->second); }
+
+  } else {
+
+    // k-way merge of the runs, with what is left in memory as the last.
+    // the eids of a key may be spread over several runs.
+    spill_run();
+
+    std::vector<std::unique_ptr<RunReader>> readers;
+    for (const auto &run : runs_) { readers.emplace_back(new RunReader(run)); }
+
+    auto later = [&] (size_t a, size_t b) {
+      return readers[a]->key() > readers[b]->key(); };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)>
+      heap(later);
+    for (size_t r = 0; r < readers.size(); ++r) {
+      if (readers[r]->next()) { heap.push(r); }
+    }
+
+    std::string key;
+    std::vector<int> eids;
+    while (!heap.empty()) {
+      key = readers[heap.top()]->key();
+      eids.clear();
+      while (!heap.empty() && readers[heap.top()]->key() == key) {
+        size_t r = heap.top();
+        heap.pop();
+        const std::vector<int> &run_eids = readers[r]->eids();
+        eids.insert(eids.end(), run_eids.begin(), run_eids.end());
+        if (readers[r]->next()) { heap.push(r); }
+      }
+      add(key, eids);
+    }
+  }
+
+  // keys and the key directory follow the postings
+  for (auto &e : entries) { e.key_offset += offset; }
+  fout << key_blob;
+  fout.write(reinterpret_cast<const char*>(entries.data()),
+             entries.size() * sizeof(DecayIndex::Entry));
+
+  std::memcpy(header.magic, index_magic, sizeof(index_magic));
+  header.n_events = n_events_;
+  header.n_keys = entries.size();
+  header.entries_offset = offset + key_blob.size();
+  header.max_tree_vertices = max_tree_vertices_;
+  fout.seekp(0);
+  write_pod(fout, header);
+
+  fout.close();
+  if (!fout) {
+    throw std::runtime_error(
+        "DecayIndexBuilder::write(): failed writing " + fname + ". ");
+  }
+
+  remove_runs();
+  postings_.clear();
+  memory_bytes_ = 0;
+  n_events_ = 0;
+}
+
+DecayIndex::DecayIndex(const std::string &fname)
+  : fin_(fname, std::ios::binary) {
+
+  if (!fin_.is_open()) {
+    throw std::runtime_error(
+        "DecayIndex::DecayIndex(): cannot open " + fname + ". ");
+  }
+  if (!fin_.read(reinterpret_cast<char*>(&header_), sizeof(header_)) ||
+      std::memcmp(header_.magic, index_magic, sizeof(index_magic)) != 0) {
+    throw std::runtime_error(
+        "DecayIndex::DecayIndex(): " + fname + " is not a decay index. ");
+  }
+}
+
+void DecayIndex::read_entry(size_t i, Entry &entry, std::string &key) {
+  fin_.seekg(header_.entries_offset + i * sizeof(Entry));
+  fin_.read(reinterpret_cast<char*>(&entry), sizeof(Entry));
+  key.resize(entry.key_len);
+  fin_.seekg(entry.key_offset);
+  fin_.read(&key[0], entry.key_len);
+  if (!fin_) {
+    throw std::runtime_error("DecayIndex::read_entry(): truncated index. ");
+  }
+}
+
+// index of the first key not less than `key`.
+size_t DecayIndex::lower_bound(const std::string &key) {
+  Entry entry;
+  std::string k;
+  size_t lo = 0, hi = header_.n_keys;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    read_entry(mid, entry, k);
+    if (k < key) { lo = mid + 1; } else { hi = mid; }
+  }
+  return lo;
+}
+
+bool DecayIndex::lookup(const std::string &key, std::vector<int> &eids) {
+
+  eids.clear();
+
+  size_t i = lower_bound(key);
+  if (i == header_.n_keys) { return false; }
+
+  Entry entry;
+  std::string k;
+  read_entry(i, entry, k);
+  if (k != key) { return false; }
+
+  std::string bytes(entry.postings_bytes, '\0');
+  fin_.seekg(entry.postings_offset);
+  fin_.read(&bytes[0], bytes.size());
+  if (!fin_) {
+    throw std::runtime_error("DecayIndex::lookup(): truncated index. ");
+  }
+  decode_postings(bytes, entry.n_eids, eids);
+  return true;
+}
+
+void DecayIndex::list(
+    const std::string &prefix,
+    const std::function<void(const std::string&, size_t)> &f) {
+
+  Entry entry;
+  std::string k;
+  for (size_t i = lower_bound(prefix); i < header_.n_keys; ++i) {
+    read_entry(i, entry, k);
+    if (k.compare(0, prefix.size(), prefix) != 0) { break; }
+    f(k, entry.n_eids);
+  }
+}
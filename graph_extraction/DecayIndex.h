@@ -0,0 +1,162 @@
+#ifndef _DECAY_INDEX_H_
+#define _DECAY_INDEX_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+// inverted index from the decays in mc graphs to the eids of the events
+// that contain them.
+//
+// every vertex with daughters contributes two keys:
+//
+// + a decay key: the lund id of the mother and the sorted lund ids of
+//   its daughters. "d:521(-423 -15 16)" is B+ -> D*0bar tau+ nu_tau,
+//   whatever the daughters decay into.
+//
+// + a tree key: the canonical signature of the whole subtree, built
+//   recursively from the mother and the sorted signatures of its
+//   daughters. "t:-423(-421(-211 321) 22)" is D*0bar -> (D0bar -> K+ pi-)
+//   gamma with stable K+, pi- and gamma. subtrees with more than
+//   max_tree_vertices vertices get no tree key, since they are nearly
+//   unique per event.
+//
+// usage:
+//
+//    DecayIndexBuilder builder;
+//    for (...each event...) { builder.add_event(eid, n_vertices, from, to, lund_id); }
+//    builder.write("mcgraph.dcyidx");
+//
+//    DecayIndex index("mcgraph.dcyidx");
+//    std::vector<int> eids;
+//    index.lookup(decay_key(521, {-423, -15, 16}), eids);
+
+// canonical keys. builder and queries must agree on these.
+std::string decay_key(int mother, std::vector<int> daughters);
+std::string tree_signature(int mother, std::vector<std::string> daughters);
+inline std::string tree_key(const std::string &signature) { return "t:" + signature; }
+
+// class that collects the keys of a stream of events and writes the index.
+// postings are held in memory as 4 bytes per distinct key per event.
+// with a memory limit, they are spilled to disk in sorted runs whenever
+// they outgrow it, and write() merges the runs into the index. the key
+// directory, about 40 bytes per key, is held in memory by write().
+class DecayIndexBuilder {
+
+  public:
+    // + max_tree_vertices: largest subtree that gets a tree key.
+    // + max_memory_bytes: postings held in memory before they are
+    //   spilled. 0 for no limit.
+    // + spill_prefix: runs are written to <spill_prefix>.run0, ...
+    //   and removed by write().
+    DecayIndexBuilder(int max_tree_vertices = 32,
+                      size_t max_memory_bytes = 0,
+                      const std::string &spill_prefix = "decay_index");
+    ~DecayIndexBuilder();
+
+    // add the mc graph of event `eid` given as edge lists, as in the
+    // edges output of extract_mcgraph.
+    void add_event(int eid, int n_vertices,
+                   const std::vector<int> &from_vertices,
+                   const std::vector<int> &to_vertices,
+                   const std::vector<int> &lund_id);
+
+    // add the mc graph of event `eid` given as the compressed daughter
+    // lists of the ntuples: the daughters of vertex i are
+    // dauidx[i], ..., dauidx[i]+daulen[i]-1.
+    void add_event_csr(int eid, int n_vertices,
+                       const std::vector<int> &daulen,
+                       const std::vector<int> &dauidx,
+                       const std::vector<int> &lund_id);
+
+    // write the index to `fname`. the builder can be reused afterwards.
+    void write(const std::string &fname);
+
+    size_t n_events() const { return n_events_; }
+
+    // number of runs spilled since the last write()
+    size_t n_runs() const { return runs_.size(); }
+
+  private:
+    void add_event(int eid, int n_vertices);
+    const std::string& signature(int v);
+    void add_key(const std::string &key, int eid);
+    void spill_run();
+    void remove_runs();
+
+  private:
+    int max_tree_vertices_;
+    size_t n_events_;
+    std::unordered_map<std::string, std::vector<int>> postings_;
+
+    // estimated bytes held by postings_, and the spilled runs
+    size_t max_memory_bytes_, memory_bytes_;
+    std::string spill_prefix_;
+    std::vector<std::string> runs_;
+
+    // graph of the current event in compressed form
+    std::vector<int> first_daughter_, daughters_, lund_id_;
+
+    // per vertex signature and subtree size. state_ is 0 while unvisited,
+    // 1 while on the search stack and 2 when done.
+    std::vector<std::string> signatures_;
+    std::vector<int> tree_sizes_;
+    std::vector<char> state_;
+};
+
+// class that answers key lookups against an index file. only the header
+// is read when opening; each lookup is a binary search over the sorted
+// key directory followed by one read of the posting list, so it takes a
+// few dozen small reads regardless of the number of events.
+class DecayIndex {
+
+  public:
+    DecayIndex(const std::string &fname);
+
+    // eids of the events containing `key`, sorted. returns false, with
+    // `eids` empty, if no event does.
+    bool lookup(const std::string &key, std::vector<int> &eids);
+
+    // call f(key, n_eids) for every key starting with `prefix`, in
+    // sorted order.
+    void list(const std::string &prefix,
+              const std::function<void(const std::string&, size_t)> &f);
+
+    size_t n_events() const { return header_.n_events; }
+    size_t n_keys() const { return header_.n_keys; }
+    int max_tree_vertices() const { return header_.max_tree_vertices; }
+
+  private:
+    // file layout: header, postings, keys, and the key directory of
+    // n_keys entries sorted by key at entries_offset.
+    struct Header {
+      char magic[8];
+      uint64_t n_events;
+      uint64_t n_keys;
+      uint64_t entries_offset;
+      uint32_t max_tree_vertices;
+      uint32_t reserved;
+    };
+
+    struct Entry {
+      uint64_t key_offset;
+      uint64_t postings_offset;
+      uint64_t postings_bytes;
+      uint32_t key_len;
+      uint32_t n_eids;
+    };
+
+    friend class DecayIndexBuilder;
+
+    void read_entry(size_t i, Entry &entry, std::string &key);
+    size_t lower_bound(const std::string &key);
+
+  private:
+    std::ifstream fin_;
+    Header header_;
+};
+
+#endif
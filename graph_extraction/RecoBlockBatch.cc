@@ -0,0 +1,397 @@
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+
+#include <pgstring_convert.h>
+
+#include "RecoBlockBatch.h"
+
+RecoBlockBatch::RecoBlockBatch(
+    const std::vector<std::string> &block_names,
+    const std::vector<int> &max_block_sizes,
+    const std::vector<int> &max_daughters,
+    const std::unordered_map<int, std::string> &lund2block) {
+  init(block_names, max_block_sizes, max_daughters, lund2block);
+}
+
+RecoBlockBatch::RecoBlockBatch(
+    const std::vector<std::string> &block_declarations) {
+
+  std::vector<std::string> block_names;
+  std::vector<int> max_block_sizes, max_daughters;
+  std::unordered_map<int, std::string> lund2block;
+
+  for (const auto &decl : block_declarations) {
+
+    std::istringstream iss(decl);
+    std::string name; int max_size, max_daus;
+    if (!(iss >> name >> max_size >> max_daus) || 
+        max_size <= 0 || max_daus < 0) {
+      throw std::invalid_argument(
+          "RecoBlockBatch::RecoBlockBatch(): malformed block declaration \"" 
+          + decl + "\". expected: name max_candidates max_daughters "
+          "lund_id... ");
+    }
+
+    block_names.push_back(name);
+    max_block_sizes.push_back(max_size);
+    max_daughters.push_back(max_daus);
+
+    int lund_id;
+    while (iss >> lund_id) { 
+      if (!lund2block.insert({lund_id, name}).second) {
+        throw std::invalid_argument(
+            "RecoBlockBatch::RecoBlockBatch(): lund id " 
+            + std::to_string(lund_id) + " declared in more than one block. ");
+      }
+    }
+    if (!iss.eof()) {
+      throw std::invalid_argument(
+          "RecoBlockBatch::RecoBlockBatch(): malformed lund id in block "
+          "declaration \"" + decl + "\". ");
+    }
+  }
+
+  init(block_names, max_block_sizes, max_daughters, lund2block);
+}
+
+void RecoBlockBatch::init(
+    const std::vector<std::string> &block_names,
+    const std::vector<int> &max_block_sizes,
+    const std::vector<int> &max_daughters,
+    const std::unordered_map<int, std::string> &lund2block) {
+
+  if (block_names.size() == 0) { 
+    throw std::length_error(
+        "RecoBlockBatch::RecoBlockBatch(): must have non-zero blocks. ");
+  }
+
+  if (block_names.size() != max_block_sizes.size() || 
+      block_names.size() != max_daughters.size()) { 
+    throw std::length_error(
+        "RecoBlockBatch::RecoBlockBatch(): block_names, max_block_sizes "
+        "and max_daughters must have the same size. ");
+  }
+
+  std::unordered_map<std::string, int> name2blockidx;
+  for (size_t b = 0; b < block_names.size(); ++b) {
+
+    Block blk;
+    blk.name_ = block_names[b];
+    blk.max_size_ = max_block_sizes[b];
+    blk.max_daughters_ = max_daughters[b];
+
+    blk.n_col_ = "n" + blk.name_;
+    blk.lund_col_ = blk.name_ + "lund";
+    blk.ndaus_col_ = blk.name_ + "ndaus";
+    for (int j = 1; j <= blk.max_daughters_; ++j) {
+      blk.dau_lund_cols_.push_back(blk.name_ + "d" + std::to_string(j) + "lund");
+      blk.dau_idx_cols_.push_back(blk.name_ + "d" + std::to_string(j) + "idx");
+    }
+    blk.dau_lund_.resize(blk.max_daughters_);
+    blk.dau_idx_.resize(blk.max_daughters_);
+    blk.dau_lund_handles_.resize(blk.max_daughters_);
+    blk.dau_idx_handles_.resize(blk.max_daughters_);
+
+    blocks_.push_back(blk);
+    if (!name2blockidx.insert({blk.name_, b}).second) {
+      throw std::invalid_argument(
+          "RecoBlockBatch::RecoBlockBatch(): block " + blk.name_ 
+          + " declared more than once. ");
+    }
+  }
+
+  for (const auto &p : lund2block) {
+    auto it = name2blockidx.find(p.second);
+    if (it == name2blockidx.end()) {
+      throw std::invalid_argument(
+          "RecoBlockBatch::RecoBlockBatch(): lund id " 
+          + std::to_string(p.first) + " maps to unknown block " 
+          + p.second + ". ");
+    }
+    lund2block_[p.first] = it->second;
+  }
+
+  clear();
+}
+
+std::vector<std::string> RecoBlockBatch::column_names() const {
+  std::vector<std::string> colnames = { "eid" };
+  for (const auto &blk : blocks_) {
+    colnames.push_back(blk.n_col_);
+    colnames.push_back(blk.lund_col_);
+    colnames.push_back(blk.ndaus_col_);
+    for (int j = 0; j < blk.max_daughters_; ++j) {
+      colnames.push_back(blk.dau_lund_cols_[j]);
+      colnames.push_back(blk.dau_idx_cols_[j]);
+    }
+  }
+  return colnames;
+}
+
+void RecoBlockBatch::clear() {
+  eid_.clear();
+  start_.clear();
+  error_.clear();
+  for (auto &blk : blocks_) {
+    blk.size_.clear();
+    blk.offset_.assign(1, 0);
+    blk.lund_.clear();
+    blk.ndaus_.clear();
+    for (auto &v : blk.dau_lund_) { v.clear(); }
+    for (auto &v : blk.dau_idx_) { v.clear(); }
+    blk.dau_gidx_.clear();
+  }
+}
+
+// look up the indices of the columns in the current cursor, so 
+// that decoding does not look up every value by name. 
+void RecoBlockBatch::bind(const PsqlReader &psql) {
+  eid_handle_ = psql.column_index("eid");
+  for (auto &blk : blocks_) {
+    blk.n_handle_ = psql.column_index(blk.n_col_);
+    blk.lund_handle_ = psql.column_index(blk.lund_col_);
+    blk.ndaus_handle_ = psql.column_index(blk.ndaus_col_);
+    for (int j = 0; j < blk.max_daughters_; ++j) {
+      blk.dau_lund_handles_[j] = psql.column_index(blk.dau_lund_cols_[j]);
+      blk.dau_idx_handles_[j] = psql.column_index(blk.dau_idx_cols_[j]);
+    }
+  }
+}
+
+size_t RecoBlockBatch::read(PsqlReader &psql, size_t max_rows) {
+
+  clear();
+  eid_.reserve(max_rows);
+  for (auto &blk : blocks_) { 
+    blk.size_.reserve(max_rows); 
+    blk.offset_.reserve(max_rows+1); 
+  }
+
+  while (eid_.size() < max_rows && psql.next()) { 
+    if (eid_.empty()) { bind(psql); }
+    decode_row(psql); 
+  }
+
+  return eid_.size();
+}
+
+// append the global start indices of every block in the last record
+void RecoBlockBatch::push_start() {
+  size_t r = eid_.size() - 1;
+  int start = 0;
+  start_.push_back(start);
+  for (const auto &blk : blocks_) {
+    start += blk.size_[r];
+    start_.push_back(start);
+  }
+}
+
+void RecoBlockBatch::append_row(
+    int eid, const std::vector<std::vector<int>> &columns) {
+
+  size_t n_columns = 0;
+  for (const auto &blk : blocks_) { n_columns += 3 + 2*blk.max_daughters_; }
+  if (columns.size() != n_columns) {
+    throw std::length_error(
+        "RecoBlockBatch::append_row(): expected " + std::to_string(n_columns) 
+        + " columns. ");
+  }
+
+  auto append = [] (const std::string &colname, const std::vector<int> &col, 
+                    int n, std::vector<int> &v) {
+    if (col.size() < static_cast<size_t>(n)) {
+      throw std::length_error(
+          "RecoBlockBatch::append_row(): " + colname + 
+          " has fewer elements than candidates. ");
+    }
+    v.insert(v.end(), col.begin(), col.begin() + n);
+  };
+
+  auto col = columns.begin();
+  for (auto &blk : blocks_) {
+
+    if (col->size() != 1 || (*col)[0] < 0 || (*col)[0] > blk.max_size_) {
+      throw std::out_of_range(
+          "RecoBlockBatch::append_row(): " + blk.n_col_ + 
+          " must be a single value within the maximum. ");
+    }
+    int n = (*col++)[0];
+    blk.size_.push_back(n);
+    blk.offset_.push_back(blk.offset_.back() + n);
+
+    append(blk.lund_col_, *col++, n, blk.lund_);
+    append(blk.ndaus_col_, *col++, n, blk.ndaus_);
+    for (int j = 0; j < blk.max_daughters_; ++j) {
+      append(blk.dau_lund_cols_[j], *col++, n, blk.dau_lund_[j]);
+      append(blk.dau_idx_cols_[j], *col++, n, blk.dau_idx_[j]);
+    }
+  }
+
+  eid_.push_back(eid);
+  push_start();
+  resolve_daughters();
+}
+
+void RecoBlockBatch::decode_row(const PsqlReader &psql) {
+
+  int eid;
+  pgstring_convert(psql.get(eid_handle_), eid);
+  eid_.push_back(eid);
+
+  for (auto &blk : blocks_) {
+
+    int n;
+    pgstring_convert(psql.get(blk.n_handle_), n);
+    if (n < 0 || n > blk.max_size_) { 
+      throw std::out_of_range(
+          "RecoBlockBatch::read(): " + blk.n_col_ + 
+          " exceeded maximum. ");
+    }
+    blk.size_.push_back(n);
+    blk.offset_.push_back(blk.offset_.back() + n);
+
+    decode_array(psql, blk.lund_handle_, blk.lund_col_, n, blk.lund_);
+    decode_array(psql, blk.ndaus_handle_, blk.ndaus_col_, n, blk.ndaus_);
+    for (int j = 0; j < blk.max_daughters_; ++j) {
+      decode_array(psql, blk.dau_lund_handles_[j], blk.dau_lund_cols_[j], 
+                   n, blk.dau_lund_[j]);
+      decode_array(psql, blk.dau_idx_handles_[j], blk.dau_idx_cols_[j], 
+                   n, blk.dau_idx_[j]);
+    }
+  }
+
+  push_start();
+  resolve_daughters();
+}
+
+// fill in the global index of every daughter in the last record. the 
+// problems found are kept rather than thrown, since records with a full 
+// block are skipped without building their graph. 
+void RecoBlockBatch::resolve_daughters() {
+
+  size_t r = eid_.size() - 1;
+  const int *start = &start_[r*(blocks_.size()+1)];
+  std::string error;
+
+  for (auto &blk : blocks_) {
+
+    int first = blk.offset_[r];
+    blk.dau_gidx_.resize(blk.offset_[r+1] * blk.max_daughters_);
+
+    for (int i = 0; i < blk.size_[r]; ++i) {
+
+      int k = first + i;
+      int *gidx = blk.dau_gidx_.data() + k * blk.max_daughters_;
+      if (blk.ndaus_[k] < 0 || blk.ndaus_[k] > blk.max_daughters_) {
+        if (error.empty()) { error = blk.ndaus_col_ + " out of range. "; }
+        continue;
+      }
+
+      for (int j = 0; j < blk.ndaus_[k]; ++j) {
+
+        int lund_id = blk.dau_lund_[j][k];
+        auto it = lund2block_.find(lund_id);
+        if (it == lund2block_.end()) {
+          if (error.empty()) {
+            error = "lund id " + std::to_string(lund_id) + " in column " 
+              + blk.dau_lund_cols_[j] + " of block " + blk.name_ 
+              + " is not declared in any block. ";
+          }
+          continue;
+        }
+
+        int db = it->second;
+        int idx = blk.dau_idx_[j][k];
+        if (idx < 0 || idx >= blocks_[db].size_[r]) {
+          if (error.empty()) {
+            error = "daughter index " + std::to_string(idx) + " in column " 
+              + blk.dau_idx_cols_[j] + " of block " + blk.name_ 
+              + " exceeded the size of block " + blocks_[db].name_ + ". ";
+          }
+          continue;
+        }
+
+        gidx[j] = start[db] + idx;
+      }
+    }
+  }
+
+  error_.push_back(error);
+}
+
+// append the first `n` elements of array column `colname` to `v`
+void RecoBlockBatch::decode_array(
+    const PsqlReader &psql, size_t col, const std::string &colname, 
+    int n, std::vector<int> &v) {
+
+  size_t size = v.size();
+  if (pgstring_append(psql.get(col), v) < static_cast<size_t>(n)) {
+    throw std::length_error(
+        "RecoBlockBatch::read(): " + colname + 
+        " has fewer elements than candidates. ");
+  }
+  v.resize(size + n);
+}
+
+bool RecoBlockBatch::has_full_block(size_t r) const {
+  for (const auto &blk : blocks_) {
+    if (blk.size_[r] >= blk.max_size_) { return true; }
+  }
+  return false;
+}
+
+std::string RecoBlockBatch::capacity_predicate() const {
+  std::string predicate;
+  for (const auto &blk : blocks_) {
+    if (!predicate.empty()) { predicate += " AND "; }
+    predicate += blk.n_col_ + " < " + std::to_string(blk.max_size_);
+  }
+  return "(" + predicate + ")";
+}
+
+void RecoBlockBatch::build_graph(size_t r, 
+    int &n_vertices, int &n_edges, 
+    std::vector<int> &from, std::vector<int> &to, 
+    std::vector<int> &lund_id, 
+    std::vector<std::vector<int>> &reco_idx) const {
+
+  if (!error_[r].empty()) {
+    throw std::out_of_range(
+        "RecoBlockBatch::build_graph(): eid " + std::to_string(eid_[r]) 
+        + ": " + error_[r]);
+  }
+
+  size_t n_blocks = blocks_.size();
+  const int *start = &start_[r*(n_blocks+1)];
+
+  // vertices: global indices and lund ids, block by block
+  n_vertices = start[n_blocks];
+  lund_id.resize(n_vertices);
+  reco_idx.resize(n_blocks);
+  for (size_t b = 0; b < n_blocks; ++b) {
+    const Block &blk = blocks_[b];
+    const int *lund = blk.lund_.data() + blk.offset_[r];
+    std::copy(lund, lund + blk.size_[r], lund_id.begin() + start[b]);
+    reco_idx[b].resize(blk.size_[r]);
+    std::iota(reco_idx[b].begin(), reco_idx[b].end(), start[b]);
+  }
+
+  // edges: from every candidate to each of its daughters
+  from.clear(); to.clear();
+  for (size_t b = 0; b < n_blocks; ++b) {
+
+    const Block &blk = blocks_[b];
+    const int *ndaus = blk.ndaus_.data() + blk.offset_[r];
+    const int *gidx = 
+      blk.dau_gidx_.data() + blk.offset_[r] * blk.max_daughters_;
+
+    for (int i = 0; i < blk.size_[r]; ++i) {
+      from.insert(from.end(), ndaus[i], start[b] + i);
+      to.insert(to.end(), gidx, gidx + ndaus[i]);
+      gidx += blk.max_daughters_;
+    }
+  }
+  n_edges = from.size();
+}
@@ -0,0 +1,202 @@
+#ifndef _RECO_BLOCK_BATCH_H_
+#define _RECO_BLOCK_BATCH_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <PsqlReader.h>
+
+// class that decodes the reconstruction blocks of a batch of bta tuple 
+// maker records into flat arrays, and assembles the reconstruction 
+// graph of each record from them. 
+//
+// bta tuple maker stores the reconstructed candidates in blocks, e.g. 
+// all B+ and B0 candidates and their anti-particles in block "B". a 
+// block holds at most max_candidates candidates of at most max_daughters 
+// daughters each. the columns of block "B" with N = max_daughters are
+//
+// + nB: integer. number of candidates in the record. 
+//
+// + Blund, Bndaus, Bd1lund, ..., BdNlund, Bd1idx, ..., BdNidx: arrays 
+//   whose first nB elements are valid. element i belongs to the 
+//   candidate with local index i. 
+//
+//   Blund: lund id of the candidate. 
+//   Bndaus: number of daughters of the candidate. 
+//   BdJlund: lund id of the Jth daughter; -1 if there is none. 
+//   BdJidx: local index of the Jth daughter within its own block; -1 if 
+//           there is none. the block is the one declaring its lund id. 
+//
+//   the daughter columns are absent if N is zero. 
+//
+// vertices are indexed globally block by block in declaration order. 
+// with blocks {"a","b","c"} of current sizes {10,5,3}: 
+//
+// gidx:  0             9   10           14  15           17
+//       [...a indices...] [...b indices...][...c indices...]
+// lidx:  0             9   0             4  0             2
+//
+// each block keeps one array per column across all records of the 
+// batch, with record `r` occupying the range [offset(r), offset(r)+size(r)). 
+// the global index of every daughter is resolved as the record is 
+// decoded, so assembling a graph only copies. nothing is reallocated 
+// between batches once the arrays have grown to fit. 
+//
+// usage: 
+//
+// 1. construct with the block names, their maximum sizes and maximum 
+//    number of daughters, and the lund id to block name mapping: 
+//
+//    RecoBlockBatch batch({"y","b"}, {800,400}, {2,4}, lund2block);
+//
+//    or equivalently, with a declaration for each block of the form 
+//    "name max_candidates max_daughters lund_id...": 
+//
+//    RecoBlockBatch batch({"y 800 2 70553", "b 400 4 521 -521 511 -511"});
+//
+// 2. select the columns that it needs, and decode batches of records:
+//
+//    psql.open_cursor(table_name, batch.column_names());
+//    while (batch.read(psql, 5000) > 0) {
+//      for (size_t r = 0; r < batch.n_rows(); ++r) {
+//        if (batch.has_full_block(r)) { continue; }
+//        batch.build_graph(r, n_vertices, n_edges, 
+//                          from, to, lund_id, reco_idx);
+//      }
+//    }
+//
+//    records decoded elsewhere, e.g. by a server side function, are 
+//    added with append_row() instead of read(): 
+//
+//    batch.clear();
+//    batch.append_row(eid, columns);
+//    batch.build_graph(0, n_vertices, n_edges, from, to, lund_id, reco_idx);
+//
+class RecoBlockBatch {
+
+  public:
+
+    // construct a batch with the following properties:
+    // + the block names are specified by `block_names`. global indices 
+    //   follow the order of the block names. 
+    // + the maximum block sizes and number of daughters are specified in 
+    //   `max_block_sizes` and `max_daughters` in the same order. 
+    // + `lund2block` maps daughter lund ids to the block they are in. 
+    RecoBlockBatch(const std::vector<std::string> &block_names,
+                   const std::vector<int> &max_block_sizes,
+                   const std::vector<int> &max_daughters,
+                   const std::unordered_map<int, std::string> &lund2block);
+
+    // construct a batch from block declarations of the form 
+    // "name max_candidates max_daughters lund_id...", where the lund ids 
+    // are those of the candidates stored in the block. 
+    RecoBlockBatch(const std::vector<std::string> &block_declarations);
+
+    // number of blocks, and the name of block `b`
+    size_t n_blocks() const { return blocks_.size(); }
+    const std::string& block_name(size_t b) const { return blocks_[b].name_; }
+
+    // names of the columns that must be selected: "eid" followed 
+    // by the columns of every block. 
+    std::vector<std::string> column_names() const;
+
+    // decode up to `max_rows` records from the current cursor of `psql`, 
+    // replacing the previous batch. returns the number of records decoded; 
+    // 0 once the cursor is exhausted. 
+    size_t read(PsqlReader &psql, size_t max_rows);
+
+    // empty the batch. 
+    void clear();
+
+    // append one record whose columns are already decoded. `columns[c]` 
+    // holds the values of column_names()[c+1]; the size columns hold a 
+    // single value. 
+    void append_row(int eid, const std::vector<std::vector<int>> &columns);
+
+    // number of records in the batch
+    size_t n_rows() const { return eid_.size(); }
+
+    // eid of record `r`
+    int eid(size_t r) const { return eid_[r]; }
+
+    // true if any of the blocks of record `r` are at full capacity
+    bool has_full_block(size_t r) const;
+
+    // sql predicate that holds for records where no block is at full 
+    // capacity; e.g. "(ny < 800 AND nb < 400)". the negation of 
+    // has_full_block(), for use in a cursor query. 
+    std::string capacity_predicate() const;
+
+    // assemble the reconstruction graph of record `r`. vertices are 
+    // indexed globally as described above. throws if a daughter of the 
+    // record has an undeclared lund id or an index past its block. 
+    // + reco_idx: element `b` lists the global indices of block `b`. 
+    void build_graph(size_t r, 
+        int &n_vertices, int &n_edges, 
+        std::vector<int> &from, std::vector<int> &to, 
+        std::vector<int> &lund_id, 
+        std::vector<std::vector<int>> &reco_idx) const;
+
+  private:
+
+    // columns of one block, concatenated over the records of the batch
+    struct Block {
+      std::string name_;
+      int max_size_;
+      int max_daughters_;
+
+      // column names, and their indices in the cursor being read
+      std::string n_col_, lund_col_, ndaus_col_;
+      std::vector<std::string> dau_lund_cols_, dau_idx_cols_;
+
+      size_t n_handle_, lund_handle_, ndaus_handle_;
+      std::vector<size_t> dau_lund_handles_, dau_idx_handles_;
+
+      // per record: size and position of its candidates
+      std::vector<int> size_;
+      std::vector<int> offset_;
+
+      // per candidate: lund id, number of daughters, and lund id and 
+      // local index of each daughter. dau_lund_[j][k] belongs to the 
+      // `j`th daughter of candidate `k`. 
+      std::vector<int> lund_;
+      std::vector<int> ndaus_;
+      std::vector<std::vector<int>> dau_lund_;
+      std::vector<std::vector<int>> dau_idx_;
+
+      // global index of the `j`th daughter of candidate `k` is 
+      // dau_gidx_[k*max_daughters_+j], for j < ndaus_[k]. 
+      std::vector<int> dau_gidx_;
+    };
+
+    void init(const std::vector<std::string> &block_names,
+              const std::vector<int> &max_block_sizes,
+              const std::vector<int> &max_daughters,
+              const std::unordered_map<int, std::string> &lund2block);
+
+    void push_start();
+    void resolve_daughters();
+    void bind(const PsqlReader &psql);
+    void decode_row(const PsqlReader &psql);
+    void decode_array(const PsqlReader &psql, size_t col, 
+                      const std::string &colname, 
+                      int n, std::vector<int> &v);
+
+  private:
+    std::vector<Block> blocks_;
+    std::unordered_map<int, int> lund2block_;
+
+    size_t eid_handle_;
+    std::vector<int> eid_;
+
+    // global start index of block `b` in record `r` is 
+    // start_[r*(n_blocks+1)+b]. the entry for b = n_blocks 
+    // is the number of vertices. 
+    std::vector<int> start_;
+
+    // per record: why its graph cannot be built; empty if it can
+    std::vector<std::string> error_;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <boost/program_options.hpp>
+
+#include "pgstring_convert.h"
+#include "CsvReader.h"
+#include "DecayIndex.h"
+
+namespace po = boost::program_options;
+
+void build_decay_index(const po::variables_map &vm);
+
+int main(int argc, char **argv) {
+
+  try {
+
+    // define program options
+    po::options_description generic("Generic options");
+    generic.add_options()
+        ("help,h", "produce help message")
+        ("max_tree_vertices", po::value<int>()->default_value(32),
+             "largest subtree, in vertices, that gets a tree key for "
+             "exact queries. ")
+        ("max_memory_mb", po::value<int>()->default_value(0),
+             "postings held in memory, in MB, before they are spilled to "
+             "sorted runs next to output_fname and merged at the end. "
+             "0 for no limit. ")
+    ;
+
+    po::options_description hidden("Hidden options");
+    hidden.add_options()
+        ("output_fname", po::value<std::string>(),
+             "decay index file to write. ")
+        ("input_fname", po::value<std::vector<std::string>>(),
+             "extract_mcgraph output files. ")
+    ;
+
+    po::options_description cmdline_options;
+    cmdline_options.add(generic).add(hidden);
+
+    po::positional_options_description p;
+    p.add("output_fname", 1).add("input_fname", -1);
+
+    po::variables_map vm;
+    store(po::command_line_parser(argc, argv).
+          options(cmdline_options).positional(p).run(), vm);
+    notify(vm);
+
+    if (vm.count("help") || !vm.count("output_fname") ||
+        !vm.count("input_fname")) {
+      std::cout << std::endl;
+      std::cout << "Usage: ./build_decay_index ";
+      std::cout << "[options] output_fname input_fname..." << std::endl;
+      std::cout << std::endl;
+      std::cout << "input_fname: output of extract_mcgraph in either "
+                   "output_format, possibly compressed. " << std::endl;
+      std::cout << std::endl;
+      std::cout << generic << "\n";
+      return 0;
+    }
+
+    // main routine
+    build_decay_index(vm);
+
+  } catch(std::exception& e) {
+
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+
+  } catch(...) {
+
+    std::cerr << "Exception of unknown type!\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+void build_decay_index(const po::variables_map &vm) {
+
+  int max_memory_mb = vm["max_memory_mb"].as<int>();
+  if (max_memory_mb < 0) {
+    throw std::invalid_argument("max_memory_mb must not be negative. ");
+  }
+
+  std::string output_fname = vm["output_fname"].as<std::string>();
+  DecayIndexBuilder builder(vm["max_tree_vertices"].as<int>(),
+                            size_t(max_memory_mb) << 20, output_fname);
+
+  int eid, n_vertices;
+  std::vector<int> from_vertices, to_vertices, daulen, dauidx, lund_id;
+
+  for (const auto &fname : vm["input_fname"].as<std::vector<std::string>>()) {
+
+    CsvReader<> csv(fname);
+
+    // the edges format has from_vertices; the csr format daulen
+    bool first = true, csr = false;
+    while (csv.next()) {
+      if (first) {
+        try { csv["daulen"]; csr = true; }
+        catch (std::out_of_range&) {}
+        first = false;
+      }
+
+      pgstring_convert(csv["eid"], eid);
+      pgstring_convert(csv["n_vertices"], n_vertices);
+      pgstring_convert(csv["lund_id"], lund_id);
+      if (csr) {
+        pgstring_convert(csv["daulen"], daulen);
+        pgstring_convert(csv["dauidx"], dauidx);
+        builder.add_event_csr(eid, n_vertices, daulen, dauidx, lund_id);
+      } else {
+        pgstring_convert(csv["from_vertices"], from_vertices);
+        pgstring_convert(csv["to_vertices"], to_vertices);
+        builder.add_event(eid, n_vertices, from_vertices, to_vertices, lund_id);
+      }
+    }
+
+    std::cout << "read " << fname << ". " << std::endl;
+  }
+
+  size_t n_events = builder.n_events(), n_runs = builder.n_runs();
+  builder.write(output_fname);
+  if (n_runs) { std::cout << "merged " << n_runs << " runs. " << std::endl; }
+
+  DecayIndex index(output_fname);
+  std::cout << "indexed " << index.n_keys() << " decays in " << n_events;
+  std::cout << " events. " << std::endl;
+
+}
@@ -4,6 +4,7 @@
 #include <utility>
 #include <unordered_map>
 #include <map>
+#include <memory>
 
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/graphviz.hpp>
@@ -29,46 +30,35 @@ template <class Name>
 class particle_writer {
 
 public:
-  particle_writer(Name name, const std::string &fname) 
-    : name_(name), pdt_(fname) {
+  particle_writer(Name name, std::shared_ptr<const ParticleTable> pdt) 
+    : name_(name), pdt_(pdt) {
   }
 
   template <class VertexOrEdge>
     void operator()(std::ostream& out, const VertexOrEdge &v) const {
-      out << "[label=\"" << pdt_.get(get(name_, v)) << "\"]";
+      out << "[label=\"" << pdt_->get(get(name_, v)) << "\"]";
     }
 
 private:
   Name name_;
-  ParticleTable pdt_;
+  std::shared_ptr<const ParticleTable> pdt_;
 };
 
 void print_usage(std::ostream &os) {
   os << "usage: ./examine_graph adjacency_fname.csv record_index" << std::endl;
+  os << "       ./examine_graph adjacency_fname.csv min_eid max_eid output_prefix";
+  os << std::endl;
   os << "adjacency_fname: first line is the title. requires these fields: ";
-  os << "n_vertices,n_edges,from_vertices,to_vertices,lund_id " << std::endl;
+  os << "eid,n_vertices,n_edges,from_vertices,to_vertices,lund_id " << std::endl;
   os << "record_index: range from 0 to the total number of records. " << std::endl;
+  os << "min_eid, max_eid: print every record with eid in [min_eid, max_eid) ";
+  os << "to output_prefix<eid>.gv, in one pass over the file. ";
+  os << "output_prefix - prints them all to stdout. " << std::endl;
 }
 
-int main(int argc, char **argv) {
-
-  // read command line
-  if (argc < 2 || argc > 3) { print_usage(std::cerr); return 1; }
-
-  std::string fname(argv[1]);
-  size_t row_index = 0;
-  if (argc == 3) { row_index = stoull(argv[2]); }
-
-  // read the csv file
-  CsvReader<> csv(fname); 
-  bool valid_record = true;
-  for (size_t i = 0; i <= row_index && (valid_record=csv.next()); ++i) ;
-
-  if (!valid_record) { 
-    std::cerr << "file does not contain at least ";
-    std::cerr << (row_index+1) << " record(s)... " << std::endl;
-    return 1;
-  }
+// print the graph of the current record of `csv` in graphviz format. 
+void print_record(std::ostream &os, CsvReader<> &csv, 
+                  const std::shared_ptr<const ParticleTable> &pdt) {
 
   // load the columns
   int n_vertices, n_edges;
@@ -108,10 +98,60 @@ int main(int argc, char **argv) {
   typedef property_map<Graph, int ParticleProperties::*>::type NameMap;
   NameMap index = get(&ParticleProperties::idx, g);
   NameMap lundmap = get(&ParticleProperties::lund_id, g);
-  boost::write_graphviz(std::cout, g, 
-                        particle_writer<NameMap>(lundmap, "../dat/pdt.dat"),
+  boost::write_graphviz(os, g, 
+                        particle_writer<NameMap>(lundmap, pdt),
                         default_writer(), default_writer(), 
                         index);
+}
+
+int main(int argc, char **argv) {
+
+  // read command line
+  if (argc < 2 || argc == 4 || argc > 5) { print_usage(std::cerr); return 1; }
+
+  std::string fname(argv[1]);
+  auto pdt = ParticleTable::load("../dat/pdt.dat");
+
+  // batch mode: one pass over the file for all records in the eid range
+  if (argc == 5) {
+
+    int min_eid = stoi(argv[2]), max_eid = stoi(argv[3]);
+    std::string prefix(argv[4]);
+
+    CsvReader<> csv(fname); 
+    size_t n_printed = 0;
+    int eid;
+    while (csv.next()) {
+      pgstring_convert(csv["eid"], eid);
+      if (eid < min_eid || eid >= max_eid) { continue; }
+      if (prefix == "-") {
+        print_record(std::cout, csv, pdt);
+      } else {
+        std::ofstream fout(prefix + std::to_string(eid) + ".gv");
+        print_record(fout, csv, pdt);
+      }
+      ++n_printed;
+    }
+
+    std::cerr << "printed " << n_printed << " graph(s). " << std::endl;
+    return 0;
+  }
+
+  size_t row_index = 0;
+  if (argc == 3) { row_index = stoull(argv[2]); }
+
+  // read the csv file
+  CsvReader<> csv(fname); 
+  bool valid_record = true;
+  for (size_t i = 0; i <= row_index && (valid_record=csv.next()); ++i) ;
+
+  if (!valid_record) { 
+    std::cerr << "file does not contain at least ";
+    std::cerr << (row_index+1) << " record(s)... " << std::endl;
+    return 1;
+  }
+
+  print_record(std::cout, csv, pdt);
 
   return 0;
 }
@@ -2,11 +2,17 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <memory>
+#include <stdexcept>
 
 #include <boost/program_options.hpp>
 
 #include "pgstring_convert.h"
 #include "PsqlReader.h"
+#include "extraction_state.h"
+#include "cursor_options.h"
+#include "CompressedOfstream.h"
+#include "DecayIndex.h"
 
 namespace po = boost::program_options;
 
@@ -30,9 +36,27 @@ int main(int argc, char **argv) {
              "name of the table to extract graph information. ")
         ("output_fname", po::value<std::string>(), 
              "output csv file name to store extracted result. ")
-        ("cursor_fetch_size", po::value<int>()->default_value(5000), 
-             "number of rows per cursor fetch. ")
+        ("output_format", po::value<std::string>()->default_value("edges"), 
+             "edges: expand the graph into edge lists. "
+             "csr: pass the compressed daughter lists daulen and dauidx "
+             "through unchanged. ")
+        ("state_table", po::value<std::string>(), 
+             "if set, run incrementally: only extract records past the "
+             "high-water eid recorded in this table. ")
+        ("state_key", po::value<std::string>()->default_value("graph"), 
+             "key of the high-water eid in state_table. ")
+        ("decay_index_fname", po::value<std::string>(), 
+             "if set, also write a decay index of the extracted graphs "
+             "to this file for query_decay_index. ")
+        ("decay_index_max_tree_vertices", po::value<int>()->default_value(32), 
+             "largest subtree, in vertices, that the decay index keys "
+             "for exact queries. ")
+        ("decay_index_max_memory_mb", po::value<int>()->default_value(0), 
+             "postings the decay index holds in memory, in MB, before "
+             "they are spilled to sorted runs next to decay_index_fname. "
+             "0 for no limit. ")
     ;
+    add_cursor_options(config);
 
     po::options_description hidden("Hidden options");
     hidden.add_options()
@@ -95,6 +119,12 @@ int main(int argc, char **argv) {
 
 void extract_mcgraph(const po::variables_map &vm) {
   
+  std::string output_format = vm["output_format"].as<std::string>();
+  if (output_format != "edges" && output_format != "csr") {
+    throw std::invalid_argument(
+        "extract_mcgraph(): unknown output_format " + output_format + ". ");
+  }
+
   // open database connection
   std::string dbname = vm["dbname"].as<std::string>();
   std::string table_name = vm["table_name"].as<std::string>();
@@ -102,15 +132,52 @@ void extract_mcgraph(const po::variables_map &vm) {
 
   PsqlReader psql;
   psql.open_connection("dbname=" + dbname);
+
+  // restrict the query to an eid shard when requested
+  std::string where_clause;
+  std::vector<std::string> params;
+  append_eid_range(vm, where_clause, params);
+
+  // in incremental mode, skip records that were already loaded
+  int high_water_eid;
+  if (vm.count("state_table") && 
+      read_high_water_eid(psql, vm["state_table"].as<std::string>(), 
+                          vm["state_key"].as<std::string>(), high_water_eid)) {
+    append_predicate(where_clause, params, "eid >", 
+                     std::to_string(high_water_eid));
+    std::cout << "incremental mode: extracting records with eid > ";
+    std::cout << high_water_eid << ". " << std::endl;
+  }
+
+  configure_cursor(psql, vm);
+
   psql.open_cursor(table_name,
       { "eid", "mclen", "daulen", "dauidx", "mclund" }, 
-      cursor_fetch_size);
+      where_clause, params, "", -1, cursor_fetch_size);
 
   // open output file and write title line
   std::string output_fname = vm["output_fname"].as<std::string>();
-  std::ofstream fout; fout.open(output_fname);
-  fout << "eid,n_vertices,n_edges,";
-  fout << "from_vertices,to_vertices,lund_id" << std::endl;
+  CompressedOfstream fout(output_fname);
+  if (output_format == "csr") {
+    fout << "eid,n_vertices,daulen,dauidx,lund_id" << std::endl;
+  } else {
+    fout << "eid,n_vertices,n_edges,";
+    fout << "from_vertices,to_vertices,lund_id" << std::endl;
+  }
+
+  // index the decays as the graphs go by
+  std::unique_ptr<DecayIndexBuilder> decay_index;
+  if (vm.count("decay_index_fname")) {
+    int max_memory_mb = vm["decay_index_max_memory_mb"].as<int>();
+    if (max_memory_mb < 0) {
+      throw std::invalid_argument(
+          "decay_index_max_memory_mb must not be negative. ");
+    }
+    decay_index.reset(new DecayIndexBuilder(
+        vm["decay_index_max_tree_vertices"].as<int>(),
+        size_t(max_memory_mb) << 20, 
+        vm["decay_index_fname"].as<std::string>()));
+  }
 
   int eid;
   int mclen;
@@ -123,12 +190,29 @@ void extract_mcgraph(const po::variables_map &vm) {
   while (psql.next()) {
     ++n_records;
 
+    // the daughter lists are already compressed. copy them through 
+    // in text form without parsing. 
+    if (output_format == "csr") {
+      fout << psql.get("eid") << ",";
+      fout << psql.get("mclen") << ",";
+      fout << psql.get("daulen") << ",";
+      fout << psql.get("dauidx") << ",";
+      fout << psql.get("mclund");
+      fout << std::endl;
+      if (!decay_index) { continue; }
+    }
+
     pgstring_convert(psql.get("eid"), eid);
     pgstring_convert(psql.get("mclen"), mclen);
     pgstring_convert(psql.get("daulen"), daulen);
     pgstring_convert(psql.get("dauidx"), dauidx);
     pgstring_convert(psql.get("mclund"), mclund);
 
+    if (decay_index) { 
+      decay_index->add_event_csr(eid, mclen, daulen, dauidx, mclund); 
+    }
+    if (output_format == "csr") { continue; }
+
     n_vertices = mclen;
 
     n_edges = 0; 
@@ -155,6 +239,10 @@ void extract_mcgraph(const po::variables_map &vm) {
   // close output file
   fout.close();
 
+  if (decay_index) {
+    decay_index->write(vm["decay_index_fname"].as<std::string>());
+  }
+
   // close database connection
   psql.close_cursor();
   psql.close_connection();
@@ -0,0 +1,48 @@
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION pg_recograph" to load this file. \quit
+
+-- reconstruction graph of one record. the vertices of block `b` (1-based, 
+-- in declaration order) are block_start[b] .. block_start[b+1]-1. 
+CREATE TYPE recograph AS (
+  n_vertices integer,
+  n_edges integer,
+  from_vertices integer[],
+  to_vertices integer[],
+  lund_id integer[],
+  block_start integer[]
+);
+
+-- build the reconstruction graph of a framework ntuple row. 
+-- `block_declarations` are of the form 
+-- "name max_candidates max_daughters lund_id...", in the order of the 
+-- global reconstruction index, as in extract_recograph. returns NULL 
+-- if any block of the row is at full capacity. the result depends only 
+-- on the arguments. the extension requires postgres 9.6 or later. 
+CREATE FUNCTION build_recograph(row_data record, block_declarations text[])
+RETURNS recograph
+AS 'MODULE_PATHNAME', 'build_recograph'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+-- same, with the BtaTupleMaker layout of this analysis. 
+CREATE FUNCTION build_recograph(row_data record)
+RETURNS recograph
+AS $$
+  SELECT build_recograph($1, ARRAY[
+    'y 800 2 70553', 
+    'b 400 4 521 -521 511 -511', 
+    'd 200 5 413 -413 423 -423 421 -421 411 -411', 
+    'c 100 2 310 213 -213 111', 
+    'h 100 2 321 -321 211 -211', 
+    'l 100 3 11 -11 13 -13', 
+    'gamma 100 0 22'
+  ]);
+$$ LANGUAGE SQL STRICT IMMUTABLE PARALLEL SAFE;
+
+-- global indices of the vertices in block `b` (1-based) of `g`; 
+-- the <name>_reco_idx column of extract_recograph. 
+CREATE FUNCTION reco_idx(g recograph, b integer)
+RETURNS integer[]
+AS $$
+  SELECT ARRAY(
+    SELECT generate_series($1.block_start[$2], $1.block_start[$2+1]-1));
+$$ LANGUAGE SQL IMMUTABLE STRICT PARALLEL SAFE;
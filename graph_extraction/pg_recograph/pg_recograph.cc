@@ -0,0 +1,259 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <exception>
+#include <stdexcept>
+
+#include "RecoBlockBatch.h"
+
+extern "C" {
+#include <postgres.h>
+#include <fmgr.h>
+#include <funcapi.h>
+#include <access/htup_details.h>
+#include <catalog/pg_type.h>
+#include <utils/array.h>
+#include <utils/builtins.h>
+#include <utils/lsyscache.h>
+#include <utils/typcache.h>
+
+PG_MODULE_MAGIC;
+
+PG_FUNCTION_INFO_V1(build_recograph);
+Datum build_recograph(PG_FUNCTION_ARGS);
+}
+
+// server side version of extract_recograph: build_recograph(row, decls)
+// assembles the reconstruction graph of one framework ntuple row with
+// RecoBlockBatch.
+//
+// postgres reports errors with longjmp, which skips c++ destructors,
+// and c++ exceptions must not unwind through postgres frames. a call
+// therefore alternates between postgres sections, which detoast the
+// arguments and columns into palloc'd buffers while no c++ object with
+// a destructor is alive, and c++ sections run by run_guarded(), which
+// touch only those buffers and the static cache. exceptions become an
+// ereport once the c++ section has unwound.
+
+namespace {
+
+// the batch is rebuilt only when the block declarations change, and the
+// column positions only when the row type changes as well.
+struct CallCache {
+  std::vector<std::string> declarations;
+  std::unique_ptr<RecoBlockBatch> batch;
+  Oid row_type = InvalidOid;
+  int32 row_typmod = -1;
+  std::vector<int> attnums;
+  std::vector<std::vector<int>> columns;
+
+  // graph of the current row
+  int n_vertices = 0, n_edges = 0;
+  std::vector<int> from, to, lund_id;
+  std::vector<std::vector<int>> reco_idx;
+};
+
+CallCache cache;
+
+// integer or integer[] column detoasted into plain memory. a null
+// column has no elements.
+struct IntColumn {
+  const int32 *data;
+  int n;
+};
+
+// run `f`, a c++ section, and report the exception it throws, if any,
+// as a postgres error after it has unwound.
+template <typename F>
+void run_guarded(F f) {
+  char errmsg_buf[512] = "";
+  try {
+    f();
+  } catch (std::exception &e) {
+    strlcpy(errmsg_buf, e.what(), sizeof(errmsg_buf));
+  } catch (...) {
+    strlcpy(errmsg_buf, "unknown exception. ", sizeof(errmsg_buf));
+  }
+  if (errmsg_buf[0] != '\0') {
+    cache.row_type = InvalidOid;
+    ereport(ERROR,
+        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+         errmsg("build_recograph(): %s", errmsg_buf)));
+  }
+}
+
+// postgres section: the block declarations as c strings.
+char** decode_declarations(ArrayType *arr, int *n) {
+  Datum *elems; bool *nulls;
+  deconstruct_array(arr, TEXTOID, -1, false, 'i', &elems, &nulls, n);
+  char **decls = static_cast<char**>(palloc(sizeof(char*) * (*n+1)));
+  for (int i = 0; i < *n; ++i) {
+    if (nulls[i]) {
+      ereport(ERROR,
+          (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+           errmsg("build_recograph(): null block declaration. ")));
+    }
+    decls[i] = text_to_cstring(DatumGetTextPP(elems[i]));
+  }
+  return decls;
+}
+
+// postgres section: the column at `attnum` of the deformed row.
+IntColumn decode_column(
+    int attnum, TupleDesc tupdesc, Datum *values, bool *nulls) {
+
+  IntColumn col = { NULL, 0 };
+  if (nulls[attnum]) { return col; }
+
+  Form_pg_attribute att = TupleDescAttr(tupdesc, attnum);
+  if (att->atttypid == INT4OID) {
+    int32 *v = static_cast<int32*>(palloc(sizeof(int32)));
+    *v = DatumGetInt32(values[attnum]);
+    col.data = v;
+    col.n = 1;
+    return col;
+  }
+
+  ArrayType *arr = DatumGetArrayTypeP(values[attnum]);
+  if (ARR_NDIM(arr) > 1 || ARR_HASNULL(arr)) {
+    ereport(ERROR,
+        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+         errmsg("build_recograph(): column %s must be one dimensional "
+                "without nulls. ", NameStr(att->attname))));
+  }
+  col.data = reinterpret_cast<const int32*>(ARR_DATA_PTR(arr));
+  col.n = ArrayGetNItems(ARR_NDIM(arr), ARR_DIMS(arr));
+  return col;
+}
+
+// c++ section: rebuild the batch if the declarations changed.
+void set_declarations(char **decl_cstrs, int n_decls) {
+  std::vector<std::string> decls(decl_cstrs, decl_cstrs + n_decls);
+  if (!cache.batch || decls != cache.declarations) {
+    cache.batch.reset(new RecoBlockBatch(decls));
+    cache.declarations = decls;
+    cache.row_type = InvalidOid;
+  }
+}
+
+// c++ section: position of every column of the batch, except eid, in
+// the row type.
+void bind_columns(TupleDesc tupdesc) {
+  std::vector<std::string> colnames = cache.batch->column_names();
+  cache.attnums.clear();
+  for (size_t c = 1; c < colnames.size(); ++c) {
+    int attnum = -1;
+    for (int i = 0; i < tupdesc->natts; ++i) {
+      Form_pg_attribute att = TupleDescAttr(tupdesc, i);
+      if (!att->attisdropped && colnames[c] == NameStr(att->attname)) {
+        attnum = i; break;
+      }
+    }
+    if (attnum < 0) {
+      throw std::invalid_argument("row has no column " + colnames[c] + ". ");
+    }
+    Oid type = TupleDescAttr(tupdesc, attnum)->atttypid;
+    if (type != INT4OID && type != INT4ARRAYOID) {
+      throw std::invalid_argument(
+          "column " + colnames[c] + " must be integer or integer[]. ");
+    }
+    cache.attnums.push_back(attnum);
+  }
+  cache.columns.resize(cache.attnums.size());
+}
+
+// c++ section: the graph of the row with the decoded `columns`. returns
+// false if the row has a full block.
+bool build_graph(const IntColumn *columns) {
+  for (size_t c = 0; c < cache.columns.size(); ++c) {
+    cache.columns[c].assign(columns[c].data, columns[c].data + columns[c].n);
+  }
+
+  RecoBlockBatch &batch = *cache.batch;
+  batch.clear();
+  batch.append_row(0, cache.columns);
+  if (batch.has_full_block(0)) { return false; }
+  batch.build_graph(0, cache.n_vertices, cache.n_edges,
+                    cache.from, cache.to, cache.lund_id, cache.reco_idx);
+  return true;
+}
+
+ArrayType* int_array(const int *v, int n) {
+  Datum *elems = static_cast<Datum*>(palloc(sizeof(Datum) * (n+1)));
+  for (int i = 0; i < n; ++i) { elems[i] = Int32GetDatum(v[i]); }
+  return construct_array(elems, n, INT4OID, 4, true, 'i');
+}
+
+}
+
+Datum build_recograph(PG_FUNCTION_ARGS) {
+
+  HeapTupleHeader row = PG_GETARG_HEAPTUPLEHEADER(0);
+  int n_decls;
+  char **decls = decode_declarations(PG_GETARG_ARRAYTYPE_P(1), &n_decls);
+
+  Oid row_type = HeapTupleHeaderGetTypeId(row);
+  int32 row_typmod = HeapTupleHeaderGetTypMod(row);
+  TupleDesc tupdesc = lookup_rowtype_tupdesc(row_type, row_typmod);
+
+  HeapTupleData tuple;
+  tuple.t_len = HeapTupleHeaderGetDatumLength(row);
+  ItemPointerSetInvalid(&(tuple.t_self));
+  tuple.t_tableOid = InvalidOid;
+  tuple.t_data = row;
+
+  Datum *values = static_cast<Datum*>(palloc(tupdesc->natts * sizeof(Datum)));
+  bool *nulls = static_cast<bool*>(palloc(tupdesc->natts * sizeof(bool)));
+  heap_deform_tuple(&tuple, tupdesc, values, nulls);
+
+  run_guarded([&] () {
+    set_declarations(decls, n_decls);
+    if (row_type != cache.row_type || row_typmod != cache.row_typmod) {
+      bind_columns(tupdesc);
+      cache.row_type = row_type;
+      cache.row_typmod = row_typmod;
+    }
+  });
+
+  int n_columns = cache.attnums.size();
+  IntColumn *columns =
+    static_cast<IntColumn*>(palloc(sizeof(IntColumn) * (n_columns+1)));
+  for (int c = 0; c < n_columns; ++c) {
+    columns[c] = decode_column(cache.attnums[c], tupdesc, values, nulls);
+  }
+  ReleaseTupleDesc(tupdesc);
+
+  bool has_graph = false;
+  run_guarded([&] () { has_graph = build_graph(columns); });
+  if (!has_graph) { PG_RETURN_NULL(); }
+
+  // block_start has one entry per block plus the number of vertices
+  int n_blocks = cache.reco_idx.size();
+  int *block_start = static_cast<int*>(palloc(sizeof(int) * (n_blocks+1)));
+  block_start[0] = 0;
+  for (int b = 0; b < n_blocks; ++b) {
+    block_start[b+1] = block_start[b] + cache.reco_idx[b].size();
+  }
+
+  TupleDesc result_desc;
+  if (get_call_result_type(fcinfo, NULL, &result_desc) != TYPEFUNC_COMPOSITE) {
+    ereport(ERROR,
+        (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+         errmsg("build_recograph(): must return the recograph type. ")));
+  }
+  result_desc = BlessTupleDesc(result_desc);
+
+  Datum result[6];
+  bool result_nulls[6] = { false, false, false, false, false, false };
+  result[0] = Int32GetDatum(cache.n_vertices);
+  result[1] = Int32GetDatum(cache.n_edges);
+  result[2] = PointerGetDatum(
+      int_array(cache.from.data(), cache.from.size()));
+  result[3] = PointerGetDatum(int_array(cache.to.data(), cache.to.size()));
+  result[4] = PointerGetDatum(
+      int_array(cache.lund_id.data(), cache.lund_id.size()));
+  result[5] = PointerGetDatum(int_array(block_start, n_blocks+1));
+
+  PG_RETURN_DATUM(
+      HeapTupleGetDatum(heap_form_tuple(result_desc, result, result_nulls)));
+}
@@ -0,0 +1,45 @@
+CREATE EXTENSION pg_recograph;
+-- fixture: framework_ntuples.csv holds four rows with a b block of up to 
+-- 4 candidates with 2 daughters and an h block of up to 4 candidates; 
+-- row 3 has a full h block and row 4 no candidates. recograph.csv is 
+-- the output of extract_recograph for it (data/extract_recograph.cfg). 
+CREATE TABLE framework_ntuples (
+  eid integer,
+  nb integer, blund integer[], bndaus integer[],
+  bd1lund integer[], bd1idx integer[], bd2lund integer[], bd2idx integer[],
+  nh integer, hlund integer[], hndaus integer[]
+);
+\copy framework_ntuples FROM 'data/framework_ntuples.csv' WITH CSV HEADER
+CREATE TABLE extract_recograph (
+  eid integer,
+  n_vertices integer, n_edges integer,
+  from_vertices integer[], to_vertices integer[], lund_id integer[],
+  b_reco_idx integer[], h_reco_idx integer[]
+);
+\copy extract_recograph FROM 'data/recograph.csv' WITH CSV HEADER
+CREATE TABLE recograph AS
+SELECT f.eid, g.n_vertices, g.n_edges,
+       g.from_vertices, g.to_vertices, g.lund_id,
+       reco_idx(g, 1) AS b_reco_idx, reco_idx(g, 2) AS h_reco_idx
+FROM framework_ntuples AS f,
+     LATERAL build_recograph(f, ARRAY['b 4 2 521 -521',
+                                      'h 4 0 211 -211 321 -321']) AS g
+WHERE g.n_vertices IS NOT NULL;
+-- rows with a full block give NULL, as extract_recograph skips them
+SELECT f.eid, build_recograph(f, ARRAY['b 4 2 521 -521',
+                                       'h 4 0 211 -211 321 -321']) IS NULL
+         AS skipped
+FROM framework_ntuples AS f
+ORDER BY f.eid;
+-- rows that differ from extract_recograph, or are missing on either side
+SELECT eid
+FROM recograph AS r FULL JOIN extract_recograph AS e USING (eid)
+WHERE (r.n_vertices, r.n_edges, r.from_vertices, r.to_vertices, r.lund_id,
+       r.b_reco_idx, r.h_reco_idx) IS DISTINCT FROM
+      (e.n_vertices, e.n_edges, e.from_vertices, e.to_vertices, e.lund_id,
+       e.b_reco_idx, e.h_reco_idx)
+ORDER BY eid;
+SELECT count(*) AS n_compared FROM recograph;
+-- malformed declarations are reported
+SELECT build_recograph(f, ARRAY['b x']) FROM framework_ntuples AS f
+WHERE f.eid = 1;
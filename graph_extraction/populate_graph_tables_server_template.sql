@@ -0,0 +1,70 @@
+-- builds the reconstruction graphs in the server with the pg_recograph 
+-- extension instead of extract_recograph. the mc graphs are still 
+-- loaded from the csv of extract_mcgraph. replace framework_ntuples with 
+-- the ntuple table to extract from. 
+
+BEGIN;
+
+CREATE EXTENSION IF NOT EXISTS pg_recograph;
+
+CREATE TEMPORARY TABLE mcgraph (
+  eid integer, 
+  n_vertices integer,
+  n_edges integer,
+  from_vertices integer[],
+  to_vertices integer[],
+  lund_id integer[]
+) ON COMMIT DROP;
+
+\copy mcgraph FROM 'mcgraph_adjacency.csv' WITH CSV HEADER;
+
+-- records with a full candidate block give NULL and are dropped. the 
+-- function is called in FROM so that it runs once per record. 
+CREATE TEMPORARY TABLE recograph ON COMMIT DROP AS 
+SELECT 
+  f.eid, 
+  g.n_vertices,
+  g.n_edges,
+  g.from_vertices,
+  g.to_vertices,
+  g.lund_id,
+  reco_idx(g, 1) AS y_reco_idx,
+  reco_idx(g, 2) AS b_reco_idx,
+  reco_idx(g, 3) AS d_reco_idx,
+  reco_idx(g, 4) AS c_reco_idx,
+  reco_idx(g, 5) AS h_reco_idx,
+  reco_idx(g, 6) AS l_reco_idx,
+  reco_idx(g, 7) AS gamma_reco_idx
+FROM 
+  framework_ntuples AS f, LATERAL build_recograph(f) AS g
+WHERE g.n_vertices IS NOT NULL;
+
+CREATE INDEX ON mcgraph (eid);
+CREATE INDEX ON recograph (eid);
+
+CREATE TABLE graph AS 
+SELECT 
+  m.eid, 
+  m.n_vertices AS mc_n_vertices,
+  m.n_edges AS mc_n_edges,
+  m.from_vertices AS mc_from_vertices,
+  m.to_vertices AS mc_to_vertices,
+  m.lund_id AS mc_lund_id,
+  r.n_vertices AS reco_n_vertices,
+  r.n_edges AS reco_n_edges,
+  r.from_vertices AS reco_from_vertices,
+  r.to_vertices AS reco_to_vertices,
+  r.lund_id AS reco_lund_id,
+  y_reco_idx,
+  b_reco_idx,
+  d_reco_idx,
+  c_reco_idx,
+  h_reco_idx,
+  l_reco_idx,
+  gamma_reco_idx
+FROM 
+  mcgraph AS m INNER JOIN recograph AS r USING (eid);
+
+CREATE INDEX ON graph (eid);
+
+COMMIT;
@@ -56,4 +56,12 @@ FROM
 
 CREATE INDEX ON graph (eid);
 
+CREATE TABLE IF NOT EXISTS extraction_state (
+  state_key text PRIMARY KEY,
+  max_eid integer
+);
+
+DELETE FROM extraction_state WHERE state_key = 'graph';
+INSERT INTO extraction_state SELECT 'graph', max(eid) FROM graph;
+
 COMMIT;
@@ -0,0 +1,364 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <memory>
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+#include <stdexcept>
+
+#include <boost/program_options.hpp>
+
+#include "ParticleTable.h"
+#include "DecayIndex.h"
+
+namespace po = boost::program_options;
+
+// node of a decay pattern. a particle that is not expanded matches any
+// decay of it, or none, unless the pattern is matched exactly.
+struct PatternNode {
+  int lund_id;
+  bool expanded;
+  std::vector<PatternNode> daughters;
+};
+
+class PatternParser {
+
+  public:
+    PatternParser(const std::string &pattern, const ParticleTable &pdt);
+    PatternNode parse();
+
+  private:
+    PatternNode parse_decay();
+    int parse_particle();
+    const std::string& peek() const;
+    std::string take();
+
+  private:
+    const ParticleTable &pdt_;
+    std::vector<std::string> tokens_;
+    size_t pos_;
+};
+
+std::vector<int> query(DecayIndex &index, const PatternNode &root, bool exact);
+void print_list(DecayIndex &index, const std::string &particle,
+                const ParticleTable &pdt);
+PatternNode conjugate(const PatternNode &node, const ParticleTable &pdt);
+
+int main(int argc, char **argv) {
+
+  try {
+
+    // define program options
+    po::options_description generic("Generic options");
+    generic.add_options()
+        ("help,h", "produce help message")
+        ("pdt_fname", po::value<std::string>()->default_value("../dat/pdt.dat"),
+             "particle data file mapping names to lund ids. ")
+        ("exact", po::bool_switch(),
+             "match whole subtrees: particles that are not expanded in the "
+             "pattern must be stable. ")
+        ("cc", po::bool_switch(),
+             "also match the charge conjugate pattern. ")
+        ("count", po::bool_switch(),
+             "print only the number of matching events. ")
+        ("list", po::bool_switch(),
+             "the pattern is a single particle: list its indexed decays "
+             "with their number of events. ")
+    ;
+
+    po::options_description hidden("Hidden options");
+    hidden.add_options()
+        ("index_fname", po::value<std::string>(), "decay index file. ")
+        ("pattern", po::value<std::string>(), "decay pattern. ")
+    ;
+
+    po::options_description cmdline_options;
+    cmdline_options.add(generic).add(hidden);
+
+    po::positional_options_description p;
+    p.add("index_fname", 1).add("pattern", 1);
+
+    po::variables_map vm;
+    store(po::command_line_parser(argc, argv).
+          options(cmdline_options).positional(p).run(), vm);
+    notify(vm);
+
+    if (vm.count("help") || !vm.count("index_fname") || !vm.count("pattern")) {
+      std::cout << std::endl;
+      std::cout << "Usage: ./query_decay_index ";
+      std::cout << "[options] index_fname pattern" << std::endl;
+      std::cout << std::endl;
+      std::cout << "pattern: mother -> daughters, with nested decays in "
+                   "brackets, e.g. " << std::endl;
+      std::cout << "  'B+ -> anti-D*0 tau+ nu_tau'" << std::endl;
+      std::cout << "  'B+ -> [anti-D*0 -> anti-D0 pi0] tau+ nu_tau'" << std::endl;
+      std::cout << "particles are pdt names or lund ids, separated by "
+                   "spaces from each other and from '->'. " << std::endl;
+      std::cout << std::endl;
+      std::cout << generic << "\n";
+      return 0;
+    }
+
+    auto pdt = ParticleTable::load(vm["pdt_fname"].as<std::string>());
+    DecayIndex index(vm["index_fname"].as<std::string>());
+    std::string pattern = vm["pattern"].as<std::string>();
+
+    if (vm["list"].as<bool>()) {
+      print_list(index, pattern, *pdt);
+      return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    PatternNode root = PatternParser(pattern, *pdt).parse();
+    bool exact = vm["exact"].as<bool>();
+    std::vector<int> eids = query(index, root, exact);
+
+    if (vm["cc"].as<bool>()) {
+      std::vector<int> cc_eids = query(index, conjugate(root, *pdt), exact);
+      std::vector<int> merged;
+      std::set_union(eids.begin(), eids.end(), cc_eids.begin(), cc_eids.end(),
+                     std::back_inserter(merged));
+      eids.swap(merged);
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    if (vm["count"].as<bool>()) {
+      std::cout << eids.size() << std::endl;
+    } else {
+      for (int eid : eids) { std::cout << eid << "\n"; }
+    }
+
+    std::cerr << eids.size() << " of " << index.n_events() << " events match. ";
+    std::cerr << "query took " << ms << " ms. " << std::endl;
+
+  } catch(std::exception& e) {
+
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+
+  } catch(...) {
+
+    std::cerr << "Exception of unknown type!\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+PatternParser::PatternParser(const std::string &pattern,
+                             const ParticleTable &pdt)
+  : pdt_(pdt), pos_(0) {
+
+  // brackets are tokens of their own; everything else is split on spaces
+  std::string spaced;
+  for (char c : pattern) {
+    if (c == '[' || c == ']') { spaced += ' '; spaced += c; spaced += ' '; }
+    else { spaced += c; }
+  }
+  std::istringstream iss(spaced);
+  std::copy(std::istream_iterator<std::string>(iss),
+            std::istream_iterator<std::string>(),
+            std::back_inserter(tokens_));
+}
+
+// pattern := decay
+// decay := particle '->' item+
+// item := particle | '[' decay ']'
+PatternNode PatternParser::parse() {
+  PatternNode root = parse_decay();
+  if (pos_ != tokens_.size()) {
+    throw std::invalid_argument(
+        "PatternParser::parse(): unexpected " + peek() + ". ");
+  }
+  return root;
+}
+
+PatternNode PatternParser::parse_decay() {
+
+  PatternNode node;
+  node.lund_id = parse_particle();
+  node.expanded = true;
+
+  if (take() != "->") {
+    throw std::invalid_argument(
+        "PatternParser::parse_decay(): expected -> after the mother. ");
+  }
+
+  while (pos_ < tokens_.size() && peek() != "]") {
+    if (peek() == "[") {
+      take();
+      node.daughters.push_back(parse_decay());
+      if (take() != "]") {
+        throw std::invalid_argument(
+            "PatternParser::parse_decay(): missing ]. ");
+      }
+    } else {
+      PatternNode daughter;
+      daughter.lund_id = parse_particle();
+      daughter.expanded = false;
+      node.daughters.push_back(daughter);
+    }
+  }
+
+  if (node.daughters.empty()) {
+    throw std::invalid_argument(
+        "PatternParser::parse_decay(): decay without daughters. ");
+  }
+  return node;
+}
+
+// a pdt name, or a lund id
+int PatternParser::parse_particle() {
+  std::string token = take();
+  if (token == "->" || token == "[" || token == "]") {
+    throw std::invalid_argument(
+        "PatternParser::parse_particle(): expected a particle, got " +
+        token + ". ");
+  }
+  try {
+    size_t n;
+    int lund_id = std::stoi(token, &n);
+    if (n == token.size()) { return lund_id; }
+  } catch (std::logic_error&) {}
+  return pdt_.get(token);
+}
+
+const std::string& PatternParser::peek() const {
+  static const std::string end = "end of pattern";
+  return pos_ < tokens_.size() ? tokens_[pos_] : end;
+}
+
+std::string PatternParser::take() {
+  std::string token = peek();
+  if (pos_ < tokens_.size()) { ++pos_; }
+  return token;
+}
+
+// decay keys of every expanded node of the pattern.
+void collect_decay_keys(const PatternNode &node, std::vector<std::string> &keys) {
+  if (!node.expanded) { return; }
+  std::vector<int> daughters;
+  for (const auto &d : node.daughters) {
+    daughters.push_back(d.lund_id);
+    collect_decay_keys(d, keys);
+  }
+  keys.push_back(decay_key(node.lund_id, daughters));
+}
+
+// tree signature of the pattern, and its number of vertices.
+std::string pattern_signature(const PatternNode &node, int &n_vertices) {
+  ++n_vertices;
+  std::vector<std::string> daughters;
+  for (const auto &d : node.daughters) {
+    daughters.push_back(pattern_signature(d, n_vertices));
+  }
+  return tree_signature(node.lund_id, daughters);
+}
+
+// eids of the events that contain the pattern.
+//
+// exact patterns are a single tree key. otherwise every decay in the
+// pattern is looked up by its decay key and the posting lists are
+// intersected, rarest first. for nested patterns this finds the events
+// that contain each of the decays, which need not be linked as in the
+// pattern; a nested pattern whose unexpanded particles are all stable
+// can be matched precisely with exact mode.
+std::vector<int> query(DecayIndex &index, const PatternNode &root, bool exact) {
+
+  std::vector<int> eids;
+
+  if (exact) {
+    int n_vertices = 0;
+    std::string sig = pattern_signature(root, n_vertices);
+    if (n_vertices > index.max_tree_vertices()) {
+      throw std::invalid_argument(
+          "query(): exact patterns may have at most " +
+          std::to_string(index.max_tree_vertices()) + " particles in "
+          "this index. ");
+    }
+    index.lookup(tree_key(sig), eids);
+    return eids;
+  }
+
+  std::vector<std::string> keys;
+  collect_decay_keys(root, keys);
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  std::vector<std::vector<int>> lists(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (!index.lookup(keys[i], lists[i])) { return eids; }
+  }
+  std::sort(lists.begin(), lists.end(),
+      [] (const std::vector<int> &a, const std::vector<int> &b) {
+        return a.size() < b.size(); });
+
+  eids.swap(lists[0]);
+  std::vector<int> tmp;
+  for (size_t i = 1; i < lists.size() && !eids.empty(); ++i) {
+    tmp.clear();
+    std::set_intersection(eids.begin(), eids.end(),
+                          lists[i].begin(), lists[i].end(),
+                          std::back_inserter(tmp));
+    eids.swap(tmp);
+  }
+  return eids;
+}
+
+// lund id of the antiparticle; self conjugate particles have no
+// negative entry in the table.
+int conjugate(int lund_id, const ParticleTable &pdt) {
+  try { pdt.get(-lund_id); return -lund_id; }
+  catch (std::out_of_range&) { return lund_id; }
+}
+
+PatternNode conjugate(const PatternNode &node, const ParticleTable &pdt) {
+  PatternNode cc = node;
+  cc.lund_id = conjugate(node.lund_id, pdt);
+  for (auto &d : cc.daughters) { d = conjugate(d, pdt); }
+  return cc;
+}
+
+// print the decays of `particle` in the index, most frequent first, with
+// lund ids translated to names.
+void print_list(DecayIndex &index, const std::string &particle,
+                const ParticleTable &pdt) {
+
+  int lund_id;
+  try {
+    size_t n;
+    lund_id = std::stoi(particle, &n);
+    if (n != particle.size()) { lund_id = pdt.get(particle); }
+  } catch (std::invalid_argument&) {
+    lund_id = pdt.get(particle);
+  }
+
+  std::vector<std::pair<size_t, std::string>> decays;
+  index.list("d:" + std::to_string(lund_id) + "(",
+      [&] (const std::string &key, size_t n_eids) {
+        decays.emplace_back(n_eids, key);
+      });
+  std::stable_sort(decays.begin(), decays.end(),
+      [] (const std::pair<size_t, std::string> &a,
+          const std::pair<size_t, std::string> &b) {
+        return a.first > b.first; });
+
+  // keys look like d:521(-423 -15 16)
+  for (const auto &d : decays) {
+    const std::string &key = d.second;
+    size_t open = key.find('(');
+    std::istringstream iss(key.substr(open+1, key.size()-open-2));
+    std::cout << d.first << "\t" << pdt.get(lund_id) << " ->";
+    for (int id; iss >> id; ) {
+      std::cout << " ";
+      try { std::cout << pdt.get(id); }
+      catch (std::out_of_range&) { std::cout << id; }
+    }
+    std::cout << "\n";
+  }
+}
@@ -5,6 +5,7 @@
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <memory>
 
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/graphviz.hpp>
@@ -12,6 +13,19 @@
 
 #include <ParticleTable.h>
 
+// assemble graphviz attributes as `,name1="value1",name2="value2"...`. 
+// writers assemble them once when a property is set, not per vertex. 
+inline std::string assemble_attribute_string(
+    const std::unordered_map<std::string, std::string> &properties) {
+  std::string s;
+  for (const auto &p : properties) {
+    s += ",";
+    s += p.first + "=";
+    s += "\"" + p.second + "\"";
+  }
+  return s;
+}
+
 // vertex or writer for arbitrary quantities 
 template <typename PropertyMapT>
 class BasicVertexWriter {
@@ -23,25 +37,21 @@ class BasicVertexWriter {
         const std::string &name, 
         const std::string &value) {
       properties_[name] = value; 
+      attributes_ = assemble_attribute_string(properties_);
     }
 
     template <typename VertexT>
       void operator()(std::ostream& out, const VertexT &v) const {
         out << "[";
         out << "label=\"" << get(pm_, v) << "\"";
-        std::string s;
-        for (const auto &p : properties_) {
-          s += ",";
-          s += p.first + "=";
-          s += "\"" + p.second + "\"";
-        }
-        out << s;
+        out << attributes_;
         out << "]";
       }
 
   protected:
     PropertyMapT pm_;
     std::unordered_map<std::string, std::string> properties_;
+    std::string attributes_;
 
 };
 
@@ -54,20 +64,26 @@ make_basic_graph_writer(PropertyMapT pm) {
 }
 
 
-// special vertex writer for lund id
+// special vertex writer for lund id. copies share the particle table. 
 template <typename LundIdPropertyMapT>
 class LundIdWriter {
 
   public:
+    LundIdWriter(LundIdPropertyMapT lund_pm, 
+                 std::shared_ptr<const ParticleTable> pdt, 
+                 bool do_name_lookup = true) 
+      : lund_pm_(lund_pm), pdt_(pdt), do_name_lookup_(do_name_lookup) {}
+
     LundIdWriter(LundIdPropertyMapT lund_pm, 
                  const std::string &fname, 
                  bool do_name_lookup = true) 
-      : lund_pm_(lund_pm), pdt_(fname), do_name_lookup_(do_name_lookup) {}
+      : LundIdWriter(lund_pm, ParticleTable::load(fname), do_name_lookup) {}
 
     void set_property(
         const std::string &name, 
         const std::string &value) {
       properties_[name] = value; 
+      attributes_ = assemble_attribute_string(properties_);
     }
 
     template <typename VertexT>
@@ -75,28 +91,22 @@ class LundIdWriter {
         out << "[";
 
         if (do_name_lookup_) {
-          out << "label=\"" << pdt_.get(get(lund_pm_, v)) << "\"";
+          out << "label=\"" << pdt_->get(get(lund_pm_, v)) << "\"";
         } else {
           out << "label=\"" << get(lund_pm_, v) << "\"";
         }
 
-        std::string s;
-        for (const auto &p : properties_) {
-          s += ",";
-          s += p.first + "=";
-          s += "\"" + p.second + "\"";
-        }
-
-        out << s;
+        out << attributes_;
         out << "]";
       }
 
   private:
     LundIdPropertyMapT lund_pm_;
-    ParticleTable pdt_;
+    std::shared_ptr<const ParticleTable> pdt_;
     bool do_name_lookup_;
 
     std::unordered_map<std::string, std::string> properties_;
+    std::string attributes_;
 };
 
 
@@ -140,104 +150,74 @@ class TruthMatchGraphPrinter {
   // the helper classes are for implementation. skip to API for usage. 
 
   // vertex writer class. models boost graph library's PropertyWriter.
+  // `matched[i]` is non-zero if the vertex with index `i` is matched. 
   template <typename LundIdPropertyMapT, typename VertexIndexPropertyMapT>
   class TruthMatchVertexWriter {
 
     public:
 
       TruthMatchVertexWriter(
-          const std::unordered_set<int> &matched_indices, 
+          const std::vector<char> &matched, 
           LundIdPropertyMapT lund_pm, 
           VertexIndexPropertyMapT idx_pm, 
           const ParticleTable &pdt,
-          const std::unordered_map<std::string, std::string> &vertex_properties,
-          const std::unordered_map<std::string, std::string> &matched_vertex_properties)
-          : matched_indices_(matched_indices), 
+          const std::string &vertex_attributes,
+          const std::string &matched_vertex_attributes)
+          : matched_(matched), 
             lund_pm_(lund_pm), idx_pm_(idx_pm), pdt_(pdt), 
-            vertex_properties_(vertex_properties),
-            matched_vertex_properties_(matched_vertex_properties) {}
+            vertex_attributes_(vertex_attributes),
+            matched_vertex_attributes_(matched_vertex_attributes) {}
 
       template <typename VertexT>
         void operator()(std::ostream& out, const VertexT &v) const {
           out << "[";
           out << "label=\"" << pdt_.get(get(lund_pm_, v)) << "\"";
-
-          std::string s;
-          if (matched_indices_.find(get(idx_pm_, v)) != matched_indices_.end()) {
-            assemble_property_string(s, matched_vertex_properties_);
+          if (matched_[get(idx_pm_, v)]) {
+            out << matched_vertex_attributes_;
           } else {
-            assemble_property_string(s, vertex_properties_);
+            out << vertex_attributes_;
           }
-
-          out << s;
           out << "]";
-
         }
 
     private:
-      void assemble_property_string(std::string &s, 
-          const std::unordered_map<std::string, std::string> &vertex_properties) const {
-        s.clear();
-        for (const auto &p : vertex_properties) {
-          s += ",";
-          s += p.first + "=";
-          s += "\"" + p.second + "\"";
-        }
-      }
-
-    private:
-      const std::unordered_set<int> &matched_indices_;
+      const std::vector<char> &matched_;
       LundIdPropertyMapT lund_pm_;
       VertexIndexPropertyMapT idx_pm_;
       const ParticleTable &pdt_;
-      const std::unordered_map<std::string, std::string> &vertex_properties_;
-      const std::unordered_map<std::string, std::string> &matched_vertex_properties_;
+      const std::string &vertex_attributes_;
+      const std::string &matched_vertex_attributes_;
 
   };
 
   // edge writer class. models boost graph library's PropertyWriter.
+  // the attribute strings are given without their leading comma. 
   template <typename MatchedEdgePropertyMapT>
   class TruthMatchEdgeWriter {
 
     public:
       TruthMatchEdgeWriter(const MatchedEdgePropertyMapT &edge_pm, 
-          const std::unordered_map<std::string, std::string> &edge_properties,
-          const std::unordered_map<std::string, std::string> &matched_edge_properties)
+          const std::string &edge_attributes,
+          const std::string &matched_edge_attributes)
         : edge_pm_(edge_pm),
-          edge_properties_(edge_properties), 
-          matched_edge_properties_(matched_edge_properties) {}
+          edge_attributes_(edge_attributes), 
+          matched_edge_attributes_(matched_edge_attributes) {}
 
       template <typename EdgeT>
         void operator()(std::ostream& out, const EdgeT &e) const {
           out << "[";
-
-          std::string s;
           if (get(edge_pm_, e)) {
-            assemble_property_string(s, matched_edge_properties_);
+            out << matched_edge_attributes_;
           } else {
-            assemble_property_string(s, edge_properties_);
+            out << edge_attributes_;
           }
-
-          out << s;
           out << "]";
-
         }
-    private:
-      void assemble_property_string(std::string &s, 
-          const std::unordered_map<std::string, std::string> &edge_properties) const {
-        s.clear();
-        for (const auto &p : edge_properties) {
-          s += p.first + "=";
-          s += "\"" + p.second + "\"";
-          s += ",";
-        }
-        s.pop_back();
-      }
 
     private: 
       const MatchedEdgePropertyMapT &edge_pm_;
-      const std::unordered_map<std::string, std::string> &edge_properties_;
-      const std::unordered_map<std::string, std::string> &matched_edge_properties_;
+      const std::string &edge_attributes_;
+      const std::string &matched_edge_attributes_;
   };
 
   // API
@@ -258,47 +238,61 @@ class TruthMatchGraphPrinter {
     template <typename GraphT, 
               typename VertexIndexPropertyMapT,
               typename LundIdPropertyMapT>
-    void print(std::ostream &os, GraphT g, 
-                const std::vector<int> matched_indices_v,
+    void print(std::ostream &os, const GraphT &g, 
+                const std::vector<int> &matched_indices_v,
                 VertexIndexPropertyMapT idx_pm, 
-                LundIdPropertyMapT lund_id_pm);
+                LundIdPropertyMapT lund_id_pm) const;
 
     // set graphviz properties for non-matched vertices
     void set_vertex_property(
         const std::string &name, const std::string &value) {
       vertex_properties_[name] = value; 
+      assemble_attributes();
     }
 
     // set graphviz properties for matched vertices
     void set_matched_vertex_property(
         const std::string &name, const std::string &value) {
       matched_vertex_properties_[name] = value; 
+      assemble_attributes();
     }
 
     // set graphviz properties for non-matched edges
     void set_edge_property(
         const std::string &name, const std::string &value) {
       edge_properties_[name] = value; 
+      assemble_attributes();
     }
 
     // set graphviz properties for matched edges
     void set_matched_edge_property(
         const std::string &name, const std::string &value) {
       matched_edge_properties_[name] = value; 
+      assemble_attributes();
     }
 
   private:
-    ParticleTable pdt_;
+    void assemble_attributes();
+
+  private:
+    std::shared_ptr<const ParticleTable> pdt_;
     std::unordered_map<std::string, std::string> vertex_properties_;
     std::unordered_map<std::string, std::string> matched_vertex_properties_;
     std::unordered_map<std::string, std::string> edge_properties_;
     std::unordered_map<std::string, std::string> matched_edge_properties_;
+
+    // attribute strings assembled from the properties above
+    std::string vertex_attributes_;
+    std::string matched_vertex_attributes_;
+    std::string edge_attributes_;
+    std::string matched_edge_attributes_;
 };
 
 
 
 // load the particle name lookup table and initialize default properties
-TruthMatchGraphPrinter::TruthMatchGraphPrinter(const std::string &fname) : pdt_(fname) {
+TruthMatchGraphPrinter::TruthMatchGraphPrinter(const std::string &fname) 
+  : pdt_(ParticleTable::load(fname)) {
   vertex_properties_["color"] = "red";
 
   matched_vertex_properties_["color"] = "red";
@@ -308,6 +302,20 @@ TruthMatchGraphPrinter::TruthMatchGraphPrinter(const std::string &fname) : pdt_(
 
   edge_properties_["color"] = "grey";
   matched_edge_properties_["penwidth"] = "3";
+
+  assemble_attributes();
+}
+
+// edge attributes are printed first, so they drop the leading comma
+inline void TruthMatchGraphPrinter::assemble_attributes() {
+  vertex_attributes_ = assemble_attribute_string(vertex_properties_);
+  matched_vertex_attributes_ = 
+    assemble_attribute_string(matched_vertex_properties_);
+  edge_attributes_ = assemble_attribute_string(edge_properties_);
+  matched_edge_attributes_ = 
+    assemble_attribute_string(matched_edge_properties_);
+  if (!edge_attributes_.empty()) { edge_attributes_.erase(0, 1); }
+  if (!matched_edge_attributes_.empty()) { matched_edge_attributes_.erase(0, 1); }
 }
 
 
@@ -316,17 +324,15 @@ template <typename GraphT,
           typename VertexIndexPropertyMapT,
           typename LundIdPropertyMapT>
 void TruthMatchGraphPrinter::print(
-    std::ostream &os, GraphT g, 
-    const std::vector<int> matched_indices_v,
+    std::ostream &os, const GraphT &g, 
+    const std::vector<int> &matched_indices_v,
     VertexIndexPropertyMapT idx_pm, 
-    LundIdPropertyMapT lund_id_pm) {
+    LundIdPropertyMapT lund_id_pm) const {
 
-  // initialize the set of matched vertices 
-  std::unordered_set<int> matched_indices_s;
-  for (int i = 0; i < matched_indices_v.size(); ++i) {
-    if (matched_indices_v[i] >= 0) {
-      matched_indices_s.insert(i);
-    }
+  // flag the matched vertices by index
+  std::vector<char> matched(matched_indices_v.size(), 0);
+  for (size_t i = 0; i < matched_indices_v.size(); ++i) {
+    if (matched_indices_v[i] >= 0) { matched[i] = 1; }
   }
 
   // initialize the set of matched edges. these are edges where both 
@@ -339,24 +345,19 @@ void TruthMatchGraphPrinter::print(
   using EdgeIterT = typename boost::graph_traits<GraphT>::edge_iterator;
   EdgeIterT ei, ei_end;
   for (std::tie(ei, ei_end) = edges(g); ei != ei_end; ++ei) {
-    if (matched_indices_s.find(g[source(*ei, g)].idx_) != matched_indices_s.end() &&
-        matched_indices_s.find(g[target(*ei, g)].idx_) != matched_indices_s.end()) {
-      edge2bool[*ei] = true;
-    } else {
-      edge2bool[*ei] = false;
-    }
+    edge2bool[*ei] = matched[g[source(*ei, g)].idx_] && 
+                     matched[g[target(*ei, g)].idx_];
   }
   
   // draw the graph by delegating the work to the respective writers. 
   boost::write_graphviz(os, g, 
 
       TruthMatchVertexWriter<LundIdPropertyMapT, VertexIndexPropertyMapT>(
-        matched_indices_s,
-        lund_id_pm, idx_pm, pdt_, 
-        vertex_properties_, matched_vertex_properties_),
+        matched, lund_id_pm, idx_pm, *pdt_, 
+        vertex_attributes_, matched_vertex_attributes_),
 
       TruthMatchEdgeWriter<decltype(matched_edge_pm)>(
-        matched_edge_pm, edge_properties_, matched_edge_properties_),
+        matched_edge_pm, edge_attributes_, matched_edge_attributes_),
 
       boost::default_writer(), idx_pm);
 
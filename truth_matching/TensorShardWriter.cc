@@ -0,0 +1,141 @@
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include <npy_write.h>
+
+#include "TensorShardWriter.h"
+
+TensorShardWriter::TensorShardWriter(
+    const std::string &output_prefix,
+    size_t shard_size, int min_padded_vertices)
+  : output_prefix_(output_prefix),
+    shard_size_(shard_size),
+    min_padded_vertices_(min_padded_vertices) {
+
+  if (shard_size_ == 0 || min_padded_vertices_ <= 0) {
+    throw std::invalid_argument(
+        "TensorShardWriter: shard_size and min_padded_vertices "
+        "must be positive. ");
+  }
+}
+
+int TensorShardWriter::padded_vertices(int n_vertices) const {
+  int v = min_padded_vertices_;
+  while (v < n_vertices) { v *= 2; }
+  return v;
+}
+
+void TensorShardWriter::add(
+    int eid, int n_vertices, int n_edges,
+    const std::vector<int> &from_vertices,
+    const std::vector<int> &to_vertices,
+    const std::vector<int> &lund_id,
+    const std::vector<int> &block_id,
+    const std::vector<int> &label) {
+
+  // check for argument consistency
+  if (from_vertices.size() != static_cast<unsigned>(n_edges) ||
+      to_vertices.size() != static_cast<unsigned>(n_edges)) {
+    throw std::invalid_argument(
+        "TensorShardWriter::add(): edge arrays must have n_edges entries. ");
+  }
+
+  if (lund_id.size() != static_cast<unsigned>(n_vertices) ||
+      block_id.size() != static_cast<unsigned>(n_vertices) ||
+      label.size() != static_cast<unsigned>(n_vertices)) {
+    throw std::invalid_argument(
+        "TensorShardWriter::add(): vertex arrays must have "
+        "n_vertices entries. ");
+  }
+
+  int v = padded_vertices(n_vertices);
+  Bucket &b = buckets_[v];
+
+  b.eid_.push_back(eid);
+  b.n_vertices_.push_back(n_vertices);
+  b.n_edges_.push_back(n_edges);
+  b.from_vertices_.insert(b.from_vertices_.end(),
+                          from_vertices.begin(), from_vertices.end());
+  b.to_vertices_.insert(b.to_vertices_.end(),
+                        to_vertices.begin(), to_vertices.end());
+  b.lund_id_.insert(b.lund_id_.end(), lund_id.begin(), lund_id.end());
+  b.block_id_.insert(b.block_id_.end(), block_id.begin(), block_id.end());
+  b.label_.insert(b.label_.end(), label.begin(), label.end());
+
+  if (b.eid_.size() == shard_size_) { write_shard(v, b); }
+}
+
+void TensorShardWriter::close() {
+
+  for (auto &p : buckets_) {
+    if (!p.second.eid_.empty()) { write_shard(p.first, p.second); }
+  }
+
+  std::ofstream fout(output_prefix_ + "_manifest.csv");
+  fout << "shard,padded_vertices,padded_edges,n_events,min_eid,max_eid";
+  fout << std::endl;
+  for (const auto &line : manifest_) { fout << line << std::endl; }
+  fout.close();
+  if (!fout) {
+    throw std::runtime_error(
+        "TensorShardWriter::close(): cannot write the manifest. ");
+  }
+}
+
+// pad the buffered events of a bucket, write them out and clear them.
+void TensorShardWriter::write_shard(int V, Bucket &b) {
+
+  size_t B = b.eid_.size();
+  int E = *std::max_element(b.n_edges_.begin(), b.n_edges_.end());
+
+  std::vector<int32_t> lund_id(B*V, 0), label(B*V, -1);
+  std::vector<int8_t> block_id(B*V, -1);
+  std::vector<uint8_t> vertex_mask(B*V, 0);
+  std::vector<int32_t> edge_index(B*2*E, 0);
+  std::vector<uint8_t> edge_mask(B*E, 0);
+
+  size_t vertex_offset = 0, edge_offset = 0;
+  for (size_t i = 0; i < B; ++i) {
+
+    for (int j = 0; j < b.n_vertices_[i]; ++j) {
+      lund_id[i*V+j] = b.lund_id_[vertex_offset+j];
+      block_id[i*V+j] = b.block_id_[vertex_offset+j];
+      label[i*V+j] = b.label_[vertex_offset+j];
+      vertex_mask[i*V+j] = 1;
+    }
+    vertex_offset += b.n_vertices_[i];
+
+    for (int j = 0; j < b.n_edges_[i]; ++j) {
+      edge_index[(i*2)*E+j] = b.from_vertices_[edge_offset+j];
+      edge_index[(i*2+1)*E+j] = b.to_vertices_[edge_offset+j];
+      edge_mask[i*E+j] = 1;
+    }
+    edge_offset += b.n_edges_[i];
+  }
+
+  std::string shard = output_prefix_ + "_v" + std::to_string(V)
+                    + "_s" + std::to_string(b.n_written_);
+
+  npy_write(shard + "_eid.npy", b.eid_, { B });
+  npy_write(shard + "_n_vertices.npy", b.n_vertices_, { B });
+  npy_write(shard + "_n_edges.npy", b.n_edges_, { B });
+  npy_write(shard + "_lund_id.npy", lund_id, { B, size_t(V) });
+  npy_write(shard + "_block_id.npy", block_id, { B, size_t(V) });
+  npy_write(shard + "_label.npy", label, { B, size_t(V) });
+  npy_write(shard + "_vertex_mask.npy", vertex_mask, { B, size_t(V) });
+  npy_write(shard + "_edge_index.npy", edge_index, { B, 2, size_t(E) });
+  npy_write(shard + "_edge_mask.npy", edge_mask, { B, size_t(E) });
+
+  manifest_.push_back(
+      shard + "," + std::to_string(V) + "," + std::to_string(E) + ","
+      + std::to_string(B) + ","
+      + std::to_string(*std::min_element(b.eid_.begin(), b.eid_.end())) + ","
+      + std::to_string(*std::max_element(b.eid_.begin(), b.eid_.end())));
+
+  // start the next shard of this bucket
+  int n_written = b.n_written_ + 1;
+  b = Bucket();
+  b.n_written_ = n_written;
+}
@@ -0,0 +1,78 @@
+#ifndef _TENSOR_SHARD_WRITER_H_
+#define _TENSOR_SHARD_WRITER_H_
+
+#include <string>
+#include <vector>
+#include <map>
+
+// class that writes reco graphs as fixed shape arrays for training.
+//
+// events are bucketed by vertex count: an event with n vertices goes to
+// the bucket whose padded vertex count V is the smallest power of two
+// >= max(n, min_padded_vertices). each bucket is written out in shards of
+// `shard_size` events; the padded edge count E of a shard is the largest
+// edge count among its events.
+//
+// each shard is a set of .npy files named <prefix>_v<V>_s<k>_<array>.npy,
+// where B is the number of events in the shard:
+// + eid, n_vertices, n_edges: int32 [B].
+// + lund_id: int32 [B, V]. 0 for padding.
+// + block_id: int8 [B, V]. reco block of each vertex; -1 for padding.
+// + label: int32 [B, V]. matched mc index of each vertex as given by
+//          TruthMatcher::get_matching(); -1 if unmatched or padding.
+// + vertex_mask: uint8 [B, V]. 1 for real vertices.
+// + edge_index: int32 [B, 2, E]. from and to vertices. 0 for padding.
+// + edge_mask: uint8 [B, E]. 1 for real edges.
+//
+// close() writes the remaining shards and <prefix>_manifest.csv, which
+// lists every shard with its padded sizes and eid range.
+class TensorShardWriter {
+
+  public:
+    TensorShardWriter(const std::string &output_prefix,
+                      size_t shard_size = 4096,
+                      int min_padded_vertices = 16);
+
+    // add one event. all per vertex arrays have `n_vertices` entries
+    // and the edge arrays `n_edges` entries.
+    void add(int eid, int n_vertices, int n_edges,
+             const std::vector<int> &from_vertices,
+             const std::vector<int> &to_vertices,
+             const std::vector<int> &lund_id,
+             const std::vector<int> &block_id,
+             const std::vector<int> &label);
+
+    // write the partially filled shards and the manifest.
+    void close();
+
+    size_t n_shards() const { return manifest_.size(); }
+
+  private:
+
+    // events of one bucket that have not been written yet. per vertex
+    // and per edge arrays of all events are concatenated.
+    struct Bucket {
+      int n_written_ = 0;
+      std::vector<int> eid_;
+      std::vector<int> n_vertices_;
+      std::vector<int> n_edges_;
+      std::vector<int> from_vertices_;
+      std::vector<int> to_vertices_;
+      std::vector<int> lund_id_;
+      std::vector<int> block_id_;
+      std::vector<int> label_;
+    };
+
+    int padded_vertices(int n_vertices) const;
+    void write_shard(int padded_vertices, Bucket &b);
+
+  private:
+    std::string output_prefix_;
+    size_t shard_size_;
+    int min_padded_vertices_;
+
+    std::map<int, Bucket> buckets_;
+    std::vector<std::string> manifest_;
+};
+
+#endif
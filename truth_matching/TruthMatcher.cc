@@ -1,68 +1,57 @@
 #include <algorithm>
-#include <unordered_set>
 #include <cmath>
-#include <queue>
-#include <map>
 #include <iostream>
+#include <stdexcept>
 
-#include <boost/property_map/property_map.hpp>
+#include <topology_hash.h>
 
 #include "TruthMatcher.h"
 
-// decide if a lund id is considered a final state
-bool is_final_state(int lund_id) {
-  switch (abs(lund_id)) {
-    case 11:
-    case 13:
-    case 211:
-    case 321:
-    case 22:
-    case 2212:
-    case 2112:
-      return true;
-  }
-  return false;
-}
-
-
-// decide if a particle is considered undetectable for truth matching
-bool is_undetectable_particle(int lund_id) {
-  switch (abs(lund_id)) {
-    case 12:
-    case 14:
-    case 15:
-    case 16:
-    case 311:
-      return true;
-  }
-  return false;
-}
-
-// decide if a particle is a valid photon mother for the purpose
-// of truth matching. 
-bool is_acceptable_photon_mother(int lund_id) {
-  switch (abs(lund_id)) {
-    case 111:
-    case 413:
-    case 423:
-      return true;
-  }
-  return false;
-}
+const int TruthMatcher::unevaluated_match;
 
 // clear data structures
 void TruthMatcher::clear_cache() {
 
-  mc_graph_.clear();
+  // the temporaries of the previous event are dead
+  arena_.reset();
+
+  reco_n_vertices_ = 0;
+  reco_from_vertices_.clear();
+  reco_to_vertices_.clear();
+  reco_lund_id_.clear();
+  reco_first_daughter_.clear();
+  reco_daughters_.clear();
+  reco_matched_idx_.clear();
+
   reco_graph_.clear();
+  reco_graph_built_ = false;
+
+  mc_n_vertices_ = 0;
+  mc_first_daughter_.clear();
+  mc_daughters_.clear();
+  mc_parent_.clear();
+  mc_lund_id_.clear();
 
+  mc_graph_.clear();
   pruned_mc_graph_.clear();
-  pruned_mcidx2vtx_.clear();
+  mc_graph_built_ = false;
+  pruned_mc_graph_built_ = false;
+
+  pruned_mc_parent_.clear();
+  pruned_mc_n_daughters_.clear();
+  pruned_mc_lund_id_.clear();
 
   matching_.clear();
+  matching_complete_ = true;
 }
 
-TruthMatcher::TruthMatcher() { clear_cache(); }
+TruthMatcher::TruthMatcher(const ParticleClassifier &classifier) 
+  : classifier_(classifier), 
+    n_pruned_mc_lookups_(0), n_pruned_mc_hits_(0) { clear_cache(); }
+
+void TruthMatcher::set_pruned_mc_cache_size(size_t capacity) {
+  pruned_mc_cache_.set_capacity(capacity);
+}
 
 
 TruthMatcher::~TruthMatcher() {}
@@ -83,233 +72,388 @@ void TruthMatcher::set_graph(
   // clear all data structures 
   clear_cache();
 
-  // construct the mc graph as well as the pruned version 
-  construct_mc_graph(
+  // load the mc graph and compute the pruned version 
+  load_mc_graph(
       mc_n_vertices, mc_n_edges,
       mc_from_vertices, mc_to_vertices,
       mc_lund_id
   );
 
-  // construct the reco graph
-  construct_reco_graph(
+  // load the reco graph. the matching is computed on request. 
+  load_reco_graph(
       reco_n_vertices, reco_n_edges,
       reco_from_vertices, reco_to_vertices,
       reco_lund_id, 
       fs_reco_idx, fs_matched_idx
   );
 
-  // compute the matching
-  compute_matching();
-
 }
 
 
 
 
-void TruthMatcher::construct_mc_graph(
-    int n_vertices, int n_edges,
-    const std::vector<int> &from_vertices, 
-    const std::vector<int> &to_vertices, 
-    const std::vector<int> &lund_id) {
+void TruthMatcher::set_graph(
+    int mc_n_vertices, 
+    const std::vector<int> &mc_daulen, 
+    const std::vector<int> &mc_dauidx, 
+    const std::vector<int> &mc_lund_id, 
+    int reco_n_vertices, int reco_n_edges, 
+    const std::vector<int> &reco_from_vertices, 
+    const std::vector<int> &reco_to_vertices, 
+    const std::vector<int> &reco_lund_id, 
+    const std::vector<std::vector<int>> &fs_reco_idx,
+    const std::vector<std::vector<int>> &fs_matched_idx) {
 
-  // build the graph
-  construct_graph(
-      mc_graph_, n_vertices, n_edges, 
-      from_vertices, to_vertices);
+  // clear all data structures 
+  clear_cache();
 
-  // attach internal properties
-  populate_lund_id(mc_graph_, lund_id);
+  // load the mc graph and compute the pruned version 
+  load_mc_graph(mc_n_vertices, mc_daulen, mc_dauidx, mc_lund_id);
 
-  // construct a pruned version
-  construct_pruned_mc_graph();
+  // load the reco graph. the matching is computed on request. 
+  load_reco_graph(
+      reco_n_vertices, reco_n_edges,
+      reco_from_vertices, reco_to_vertices,
+      reco_lund_id, 
+      fs_reco_idx, fs_matched_idx
+  );
 
 }
 
-// the pruned mc graph is the target of graph matching. the un-pruned
-// mc graph has too many artifacts and spurious particles
-void TruthMatcher::construct_pruned_mc_graph() {
+void TruthMatcher::load_mc_graph(
+    int n_vertices, int n_edges,
+    const std::vector<int> &from_vertices, 
+    const std::vector<int> &to_vertices, 
+    const std::vector<int> &lund_id) {
 
-  // start with a copy of the original mc_graph 
-  pruned_mc_graph_ = mc_graph_;
+  // check for argument consistency
+  if (from_vertices.size() != static_cast<unsigned>(n_edges)) {
+    throw std::invalid_argument(
+        "TruthMatcher::load_mc_graph(): n_edges and " 
+        "from_vertices.size() must agree. "
+    );
+  }
 
-  // remove subtrees for final states reachable from the decay root
-  remove_final_state_subtrees(pruned_mc_graph_);
+  if (to_vertices.size() != from_vertices.size()) {
+    throw std::invalid_argument(
+        "TruthMatcher::load_mc_graph(): from_vertices.size() "
+        "must agree with to_vertices.size(). "
+    );
+  }
 
-  // rip out particles that are not relevant for truth matching
-  rip_irrelevant_particles(pruned_mc_graph_);
+  if (lund_id.size() != static_cast<unsigned>(n_vertices)) {
+    throw std::invalid_argument(
+        "TruthMatcher::load_mc_graph(): lund_id.size() "
+        "must agree with n_vertices. "
+    );
+  }
 
-  // populate the index to vertex mapping. needed later 
-  // for computing the matching
-  pruned_mcidx2vtx_.clear();
-  VertexIter vi, vi_end;
-  for (std::tie(vi, vi_end) = vertices(pruned_mc_graph_); 
-       vi != vi_end; ++vi) {
-    pruned_mcidx2vtx_[pruned_mc_graph_[*vi].idx_] = *vi;
+  for (int i = 0; i < n_edges; ++i) {
+    if (from_vertices[i] < 0 || from_vertices[i] >= n_vertices || 
+        to_vertices[i] < 0 || to_vertices[i] >= n_vertices) {
+      throw std::invalid_argument(
+          "TruthMatcher::load_mc_graph(): edge endpoints must "
+          "lie in [0, n_vertices). "
+      );
+    }
   }
 
-}
+  // daughters of each vertex in edge order, and the mother of each vertex
+  mc_n_vertices_ = n_vertices;
+  mc_lund_id_ = lund_id;
 
+  mc_parent_.assign(n_vertices, -1);
+  mc_first_daughter_.assign(n_vertices+1, 0);
+  for (int i = 0; i < n_edges; ++i) { ++mc_first_daughter_[from_vertices[i]+1]; }
+  for (int i = 0; i < n_vertices; ++i) { 
+    mc_first_daughter_[i+1] += mc_first_daughter_[i]; 
+  }
 
-void TruthMatcher::rip_irrelevant_particles(Graph &g) {
+  mc_daughters_.resize(n_edges);
+  ArenaVector<int> pos(mc_first_daughter_.begin(), mc_first_daughter_.end()-1, 
+                       ArenaAllocator<int>(arena_));
+  for (int i = 0; i < n_edges; ++i) {
+    int u = from_vertices[i], v = to_vertices[i];
+    mc_daughters_[pos[u]++] = v;
+    if (mc_parent_[v] < 0) { mc_parent_[v] = u; }
+  }
 
-  // set of particles that need to be ripped. keyed by mc idx_.
-  std::unordered_set<int> to_rip;
+  // compute the pruned version
+  prune_mc_graph_memoized();
 
-  // stage the incoming e+ and e- particles for ripping
-  // their mc indices are 0 and 1 by construction
-  to_rip.insert(0);
-  to_rip.insert(1);
+}
 
-  // stage undetectable particles for ripping
-  IntPropertyMap index_pm = get(&VertexProperties::idx_, g);
-  IntPropertyMap lund_pm = get(&VertexProperties::lund_id_, g);
+void TruthMatcher::load_mc_graph(
+    int n_vertices, 
+    const std::vector<int> &daulen, 
+    const std::vector<int> &dauidx, 
+    const std::vector<int> &lund_id) {
 
-  VertexIter vi, vi_end;
-  for (std::tie(vi, vi_end) = vertices(g); vi != vi_end; ++vi) {
-    if (is_undetectable_particle(get(lund_pm, *vi))) {
-      to_rip.insert(get(index_pm, *vi));
-    }
+  // check for argument consistency
+  if (daulen.size() != static_cast<unsigned>(n_vertices) || 
+      dauidx.size() != static_cast<unsigned>(n_vertices)) {
+    throw std::invalid_argument(
+        "TruthMatcher::load_mc_graph(): daulen.size() and "
+        "dauidx.size() must agree with n_vertices. "
+    );
   }
 
-  // stage photons that do not descend from acceptable mothers for ripping
-  for (std::tie(vi, vi_end) = vertices(g); vi != vi_end; ++vi) {
-
-    if (get(lund_pm, *vi) == 22) {
+  if (lund_id.size() != static_cast<unsigned>(n_vertices)) {
+    throw std::invalid_argument(
+        "TruthMatcher::load_mc_graph(): lund_id.size() "
+        "must agree with n_vertices. "
+    );
+  }
 
-      InEdgeIter ie, ie_end;
-      std::tie(ie, ie_end) = in_edges(*vi, g);
+  // the daughters are already contiguous; only their ranges need 
+  // checking. the mother of each vertex is the first to list it. 
+  mc_n_vertices_ = n_vertices;
+  mc_lund_id_ = lund_id;
 
-      Vertex u = source(*ie, g);
-      if (!is_acceptable_photon_mother(get(lund_pm, u))) {
-        to_rip.insert(get(index_pm, *vi));
+  mc_parent_.assign(n_vertices, -1);
+  mc_first_daughter_.assign(n_vertices+1, 0);
+  mc_daughters_.clear();
+  for (int i = 0; i < n_vertices; ++i) {
+    if (daulen[i] > 0 && dauidx[i] > 0) {
+      if (dauidx[i] + daulen[i] > n_vertices) {
+        throw std::invalid_argument(
+            "TruthMatcher::load_mc_graph(): daughter ranges must "
+            "lie in [0, n_vertices). "
+        );
+      }
+      for (int v = dauidx[i]; v < dauidx[i]+daulen[i]; ++v) {
+        mc_daughters_.push_back(v);
+        if (mc_parent_[v] < 0) { mc_parent_[v] = i; }
       }
-
-      // note: assume only one mother! 
-      assert(++ie == ie_end);
-
     }
+    mc_first_daughter_[i+1] = mc_daughters_.size();
   }
 
-  // rip vertices by contracting with its mother. in the case of 
-  // no mothers, the procedure is equivalent to just removing 
-  // the vertex and outgoing edges. 
-  //
-  // be careful with iterator invalidation
-  VertexIter next; std::tie(vi, vi_end) = vertices(g);
-  for (next = vi; vi != vi_end; vi = next) {
-    ++next;
-
-    if (to_rip.find(g[*vi].idx_) != to_rip.end()) {
-
-      // add edges from mother to daughters
-      InEdgeIter ie, ie_end;
-      for (std::tie(ie, ie_end) = in_edges(*vi, g); ie != ie_end; ++ie) {
-        Vertex u = source(*ie, g);
-
-        OutEdgeIter oe, oe_end;
-        for (std::tie(oe, oe_end) = out_edges(*vi, g); oe != oe_end; ++oe) {
-          Vertex v = target(*oe, g);
-          add_edge(u, v, g);
-        }
-      }
+  // compute the pruned version
+  prune_mc_graph_memoized();
 
-      // clear and remove the vertex
-      clear_vertex(*vi, g);
-      remove_vertex(*vi, g);
-    }
-  }
 }
 
+// compute the pruned mc graph, but first look for the mc graph in the 
+// pruned mc cache if it is enabled. generic mc samples repeat the same 
+// decay topologies many times, so most events are expected to hit. 
+void TruthMatcher::prune_mc_graph_memoized() {
+
+  if (pruned_mc_cache_.capacity() == 0) { prune_mc_graph(); return; }
+
+  size_t key = topology_hash(
+      mc_n_vertices_, mc_first_daughter_, mc_daughters_, mc_lund_id_);
+
+  ++n_pruned_mc_lookups_;
+  PrunedMcEntry *e = pruned_mc_cache_.find(key);
+  if (e && e->n_vertices_ == mc_n_vertices_ && 
+      e->first_daughter_ == mc_first_daughter_ && 
+      e->daughters_ == mc_daughters_ && 
+      e->lund_id_ == mc_lund_id_) {
+    ++n_pruned_mc_hits_;
+    pruned_mc_parent_ = e->parent_;
+    pruned_mc_n_daughters_ = e->n_daughters_;
+    pruned_mc_lund_id_ = mc_lund_id_;
+    return;
+  }
 
-void TruthMatcher::remove_final_state_subtrees(Graph &g) {
+  prune_mc_graph();
 
-  // find the decay root. this is the first daughter of the e+e- collision
-  Vertex decay_root;
+  pruned_mc_cache_.insert(key, PrunedMcEntry { 
+      mc_n_vertices_, mc_first_daughter_, mc_daughters_, mc_lund_id_,
+      pruned_mc_parent_, pruned_mc_n_daughters_ });
+}
 
-  VertexIter vi, vi_end;
-  for (std::tie(vi, vi_end) = vertices(g); vi != vi_end; ++vi) {
-    if (g[*vi].idx_ == 2) { decay_root = *vi; break; }
-  }
+// the pruned mc graph is the target of graph matching. the un-pruned
+// mc graph has too many artifacts and spurious particles. 
+//
+// the pruning is computed directly on the input arrays in a few linear 
+// passes, and is recorded as the mother, daughter count and lund id of 
+// every pruned mc vertex in arrays indexed by mc idx_. the matching then 
+// checks common mothers with array reads instead of walking edge lists. 
+//
+// note: assumes each mc particle has at most one mother. 
+void TruthMatcher::prune_mc_graph() {
+
+  int n = mc_n_vertices_;
+  const std::vector<int> &parent = mc_parent_;
+  const std::vector<int> &first_daughter = mc_first_daughter_;
+  const std::vector<int> &daughters = mc_daughters_;
 
-  if (vi == vi_end) {
+  // find the decay root. this is the first daughter of the e+e- collision
+  if (n <= 2) {
     throw std::runtime_error(
-        "TruthMatcher::remove_final_state_subtrees(): " 
+        "TruthMatcher::prune_mc_graph(): " 
         "couldn't find mc_idx 2. ");
   }
 
-  // BFS for the final states and label their subtrees for removal.
-  // labelling and then removing avoids iterator invalidation. 
-  std::vector<Vertex> to_remove;
-  IntPropertyMap lund_pm = get(&VertexProperties::lund_id_, g);
+  // BFS from the decay root for the final states. the subtrees 
+  // of their daughters are removed. 
+  ArenaAllocator<char> char_alloc(arena_);
+  ArenaAllocator<int> int_alloc(arena_);
+  ArenaVector<char> visited(n, 0, char_alloc), removed(n, 0, char_alloc);
+  ArenaVector<int> q(int_alloc), subtree_q(int_alloc); 
+  q.reserve(n); subtree_q.reserve(n);
+
+  visited[2] = 1; q.push_back(2);
+  for (size_t h = 0; h < q.size(); ++h) {
+
+    int u = q[h];
+    bool final_state = classifier_.is_final_state(mc_lund_id_[u]);
+
+    for (int k = first_daughter[u]; k < first_daughter[u+1]; ++k) {
+      int v = daughters[k];
+      if (final_state) { 
+        label_for_removal(v, first_daughter, daughters, removed, subtree_q);
+      } else if (!visited[v]) {
+        visited[v] = 1; q.push_back(v);
+      }
+    }
+  }
+
+  // decide which of the remaining particles are relevant for truth 
+  // matching. the rest are ripped by contracting them with their mother: 
+  // - the incoming e+ and e-. their mc indices are 0 and 1 by construction.
+  // - undetectable particles. 
+  // - photons that do not descend from acceptable mothers. 
+  ArenaVector<char> keep(n, 0, char_alloc);
+  for (int v = 0; v < n; ++v) {
+    if (removed[v] || v == 0 || v == 1) { continue; }
+
+    int lund_id = mc_lund_id_[v];
+    if (classifier_.is_undetectable_particle(lund_id)) { continue; }
+    if (lund_id == 22 && (parent[v] < 0 || removed[parent[v]] || 
+          !classifier_.is_acceptable_photon_mother(
+            mc_lund_id_[parent[v]]))) { continue; }
+
+    keep[v] = 1;
+  }
 
-  std::unordered_set<Vertex> visited;
+  // the mother of a vertex in the pruned graph is its nearest kept 
+  // ancestor. visit mothers before daughters, starting from the roots. 
+  ArenaVector<int> kept_ancestor(n, -1, int_alloc);
+  q.clear();
+  for (int v = 0; v < n; ++v) {
+    if (parent[v] < 0 && !removed[v]) { q.push_back(v); }
+  }
+  for (size_t h = 0; h < q.size(); ++h) {
+    int u = q[h];
+    for (int k = first_daughter[u]; k < first_daughter[u+1]; ++k) {
+      int v = daughters[k];
+      if (removed[v] || parent[v] != u) { continue; }
+      kept_ancestor[v] = keep[u] ? u : kept_ancestor[u];
+      q.push_back(v);
+    }
+  }
 
-  std::queue<Vertex> q; 
-  visited.insert(decay_root); q.push(decay_root);
-  while (!q.empty()) {
+  // flatten into arrays. needed later for computing the matching
+  pruned_mc_parent_.assign(n, -1);
+  pruned_mc_n_daughters_.assign(n, -1);
+  pruned_mc_lund_id_ = mc_lund_id_;
 
-    Vertex u = q.front(); q.pop();
+  for (int v = 0; v < n; ++v) {
+    if (keep[v]) { pruned_mc_n_daughters_[v] = 0; }
+  }
+  for (int v = 0; v < n; ++v) {
+    if (!keep[v] || kept_ancestor[v] < 0) { continue; }
+    pruned_mc_parent_[v] = kept_ancestor[v];
+    ++pruned_mc_n_daughters_[kept_ancestor[v]];
+  }
 
-    // if `u` is considered a final state, then label all its daughter
-    // subtrees for removal
-    if (is_final_state(get(lund_pm, u))) {
+}
 
-      OutEdgeIter oe, oe_end;
-      for (std::tie(oe, oe_end) = out_edges(u, g); 
-           oe != oe_end; ++oe) {
-        Vertex v = target(*oe, g);
-        label_for_removal(v, g, to_remove);
-      }
+// mark every vertex in the subtree of `r` as removed. `q` is scratch 
+// space for the search. 
+void TruthMatcher::label_for_removal(int r, 
+    const std::vector<int> &first_daughter, 
+    const std::vector<int> &daughters, 
+    ArenaVector<char> &removed, 
+    ArenaVector<int> &q) {
+
+  if (removed[r]) { return; }
+
+  q.clear();
+  removed[r] = 1; q.push_back(r);
+  for (size_t h = 0; h < q.size(); ++h) {
+    int u = q[h];
+    for (int k = first_daughter[u]; k < first_daughter[u+1]; ++k) {
+      int v = daughters[k];
+      if (!removed[v]) { removed[v] = 1; q.push_back(v); }
+    }
+  }
+}
 
-    // if not a final state then continue exploring its daughters
-    } else {
+void TruthMatcher::build_mc_graph() const {
 
-      OutEdgeIter oe, oe_end;
-      for (std::tie(oe, oe_end) = out_edges(u, g); 
-           oe != oe_end; ++oe) {
-        Vertex v = target(*oe, g);
-        if (visited.find(v) == visited.end()) {
-          visited.insert(v); q.push(v);
-        }
-      }
+  if (mc_graph_built_) { return; }
 
+  // build the graph
+  std::vector<int> from_vertices, to_vertices;
+  for (int u = 0; u < mc_n_vertices_; ++u) {
+    for (int k = mc_first_daughter_[u]; k < mc_first_daughter_[u+1]; ++k) {
+      from_vertices.push_back(u);
+      to_vertices.push_back(mc_daughters_[k]);
     }
   }
+  construct_graph(
+      mc_graph_, mc_n_vertices_, from_vertices.size(), 
+      from_vertices, to_vertices);
 
-  // remove those vertices that were labelled
-  for (auto u : to_remove) {
-    clear_vertex(u, g);
-    remove_vertex(u, g);
-  }
+  // attach internal properties
+  populate_lund_id(mc_graph_, mc_lund_id_);
+
+  mc_graph_built_ = true;
 }
 
-// push vertices in the subtree of `r` into `to_remove`.
-// perform BFS and push all reachable vertices
-void TruthMatcher::label_for_removal(Vertex r, Graph &g, std::vector<Vertex> &to_remove) {
+void TruthMatcher::build_pruned_mc_graph() const {
 
-  std::unordered_set<Vertex> visited;
+  if (pruned_mc_graph_built_) { return; }
 
-  std::queue<Vertex> q; 
-  visited.insert(r); q.push(r);
+  pruned_mc_graph_.clear();
 
-  while (!q.empty()) {
+  // insert the kept vertices and bind internal properties
+  std::vector<Vertex> vertex_map(pruned_mc_parent_.size());
+  for (size_t i = 0; i < pruned_mc_parent_.size(); ++i) {
+    if (pruned_mc_n_daughters_[i] < 0) { continue; }
+    Vertex u = boost::add_vertex(pruned_mc_graph_);
+    vertex_map[i] = u;
+    pruned_mc_graph_[u].idx_ = i;
+    pruned_mc_graph_[u].lund_id_ = pruned_mc_lund_id_[i];
+  }
 
-    Vertex u = q.front(); q.pop();
+  // insert edges
+  std::vector<int> from_vertices, to_vertices;
+  get_pruned_mc_edges(from_vertices, to_vertices);
+  for (size_t i = 0; i < from_vertices.size(); ++i) {
+    boost::add_edge(vertex_map[from_vertices[i]], 
+                    vertex_map[to_vertices[i]], pruned_mc_graph_);
+  }
 
-    OutEdgeIter oe, oe_end;
-    std::tie(oe, oe_end) = out_edges(u, g);
-    for (; oe != oe_end; ++oe) {
-      Vertex v = target(*oe, g);
-      if (visited.find(v) == visited.end()) {
-        visited.insert(v); q.push(v);
-      }
+  pruned_mc_graph_built_ = true;
+}
+
+void TruthMatcher::get_pruned_mc_edges(
+    std::vector<int> &from_vertices, 
+    std::vector<int> &to_vertices) const {
+
+  from_vertices.clear(); to_vertices.clear();
+
+  ArenaVector<std::pair<int, int>> edges(
+      (ArenaAllocator<std::pair<int, int>>(arena_)));
+  for (size_t v = 0; v < pruned_mc_parent_.size(); ++v) {
+    if (pruned_mc_parent_[v] >= 0) { 
+      edges.emplace_back(pruned_mc_parent_[v], v); 
     }
+  }
+  std::sort(edges.begin(), edges.end());
 
-    to_remove.push_back(u);
+  for (const auto &e : edges) {
+    from_vertices.push_back(e.first);
+    to_vertices.push_back(e.second);
   }
 }
 
-void TruthMatcher::construct_reco_graph(
+void TruthMatcher::load_reco_graph(
     int n_vertices, int n_edges,
     const std::vector<int> &from_vertices, 
     const std::vector<int> &to_vertices, 
@@ -317,20 +461,89 @@ void TruthMatcher::construct_reco_graph(
     const std::vector<std::vector<int>> &fs_reco_idx,
     const std::vector<std::vector<int>> &fs_matched_idx) {
 
+  // check for argument consistency
+  if (from_vertices.size() != static_cast<unsigned>(n_edges)) {
+    throw std::invalid_argument(
+        "TruthMatcher::load_reco_graph(): n_edges and " 
+        "from_vertices.size() must agree. "
+    );
+  }
+
+  if (to_vertices.size() != from_vertices.size()) {
+    throw std::invalid_argument(
+        "TruthMatcher::load_reco_graph(): from_vertices.size() "
+        "must agree with to_vertices.size(). "
+    );
+  }
+
+  if (lund_id.size() != static_cast<unsigned>(n_vertices)) {
+    throw std::invalid_argument(
+        "TruthMatcher::load_reco_graph(): lund_id.size() "
+        "must agree with n_vertices. "
+    );
+  }
+
+  for (int i = 0; i < n_edges; ++i) {
+    if (from_vertices[i] < 0 || from_vertices[i] >= n_vertices || 
+        to_vertices[i] < 0 || to_vertices[i] >= n_vertices) {
+      throw std::invalid_argument(
+          "TruthMatcher::load_reco_graph(): edge endpoints must "
+          "lie in [0, n_vertices). "
+      );
+    }
+  }
+
+  // keep the arrays. the boost graph is built from them on request. 
+  reco_n_vertices_ = n_vertices;
+  reco_from_vertices_ = from_vertices;
+  reco_to_vertices_ = to_vertices;
+  reco_lund_id_ = lund_id;
+
+  // daughters of each vertex in edge order
+  reco_first_daughter_.assign(n_vertices+1, 0);
+  for (int i = 0; i < n_edges; ++i) { ++reco_first_daughter_[from_vertices[i]+1]; }
+  for (int i = 0; i < n_vertices; ++i) { 
+    reco_first_daughter_[i+1] += reco_first_daughter_[i]; 
+  }
+
+  reco_daughters_.resize(n_edges);
+  ArenaVector<int> pos(reco_first_daughter_.begin(), 
+                       reco_first_daughter_.end()-1, 
+                       ArenaAllocator<int>(arena_));
+  for (int i = 0; i < n_edges; ++i) {
+    reco_daughters_[pos[from_vertices[i]]++] = to_vertices[i];
+  }
+
+  // final state matched index. note that these are the matched indices 
+  // given from babar. they are, after slight modifications, used as the 
+  // base case of the matching. 
+  populate_reco_matched_idx(n_vertices, fs_reco_idx, fs_matched_idx);
+
+  // nothing is matched until requested
+  matching_.assign(n_vertices, unevaluated_match);
+  matching_complete_ = false;
+
+}
+
+void TruthMatcher::build_reco_graph() const {
+
+  if (reco_graph_built_) { return; }
+
   // build the graph itself
   construct_graph(
-      reco_graph_, n_vertices, n_edges, 
-      from_vertices, to_vertices);
+      reco_graph_, reco_n_vertices_, reco_from_vertices_.size(), 
+      reco_from_vertices_, reco_to_vertices_);
 
   // attach internal properties: lund id
-  populate_lund_id(reco_graph_, lund_id);
+  populate_lund_id(reco_graph_, reco_lund_id_);
 
   // attach internal properties: final state matched index. 
-  // note that these are the matched indices given from babar. they are, 
-  // after slight modifications, used as the base case of our dfs_visitor.
-  populate_reco_matched_idx(reco_graph_, n_vertices, 
-      fs_reco_idx, fs_matched_idx);
+  VertexIter vi, vi_end;
+  for (std::tie(vi, vi_end) = vertices(reco_graph_); vi != vi_end; ++vi) {
+    reco_graph_[*vi].matched_idx_ = reco_matched_idx_[reco_graph_[*vi].idx_];
+  }
 
+  reco_graph_built_ = true;
 }
 
 
@@ -338,7 +551,7 @@ void TruthMatcher::construct_graph(
     Graph &g, 
     int n_vertices, int n_edges,
     const std::vector<int> &from_vertices, 
-    const std::vector<int> &to_vertices) {
+    const std::vector<int> &to_vertices) const {
 
   // check for argument consistency
   if (from_vertices.size() != static_cast<unsigned>(n_edges)) {
@@ -378,7 +591,7 @@ void TruthMatcher::construct_graph(
 
 void TruthMatcher::populate_lund_id(
     Graph &g, 
-    const std::vector<int> &lund_id) {
+    const std::vector<int> &lund_id) const {
 
   // check for argument consistency
   if (lund_id.size() != num_vertices(g)) {
@@ -398,7 +611,6 @@ void TruthMatcher::populate_lund_id(
 
 
 void TruthMatcher::populate_reco_matched_idx(
-    Graph &g, 
     int n_vertices,
     const std::vector<std::vector<int>> &fs_reco_idx,
     const std::vector<std::vector<int>> &fs_matched_idx) {
@@ -406,12 +618,12 @@ void TruthMatcher::populate_reco_matched_idx(
   // concatenate final state matched mc indices
   // ------------------------------------------
 
-  std::vector<int> concat_fs_reco_idx;
+  ArenaVector<int> concat_fs_reco_idx((ArenaAllocator<int>(arena_)));
   for (const auto &vi : fs_reco_idx) {
     std::copy(vi.begin(), vi.end(), std::back_inserter(concat_fs_reco_idx));
   }
 
-  std::vector<int> concat_fs_matched_idx;
+  ArenaVector<int> concat_fs_matched_idx((ArenaAllocator<int>(arena_)));
   for (const auto &vi : fs_matched_idx) {
     std::copy(vi.begin(), vi.end(), std::back_inserter(concat_fs_matched_idx));
   }
@@ -426,67 +638,72 @@ void TruthMatcher::populate_reco_matched_idx(
   // populating matched indices of the entire reco graph
   // ---------------------------------------------------
 
-  if (static_cast<unsigned>(n_vertices) != num_vertices(g)) {
-    throw std::runtime_error(
-        "TruthMatcher::populate_matched_idx(): n_vertices "
-        "must agree with num_vertices(g). "
-    );
-  }
-
   // determine values for every reco index. note that 
   // composite particles get -1. 
-  std::vector<int> matched_idx(n_vertices, -1);
+  reco_matched_idx_.assign(n_vertices, -1);
   for (size_t i = 0; i < concat_fs_reco_idx.size(); ++i) {
+    if (concat_fs_reco_idx[i] < 0 || concat_fs_reco_idx[i] >= n_vertices) {
+      throw std::runtime_error(
+          "TruthMatcher::populate_matched_idx(): fs_reco_idx "
+          "must lie in [0, n_vertices). "
+      );
+    }
     if (concat_fs_matched_idx[i] >= 0) { 
-      matched_idx[concat_fs_reco_idx[i]] = concat_fs_matched_idx[i];
+      reco_matched_idx_[concat_fs_reco_idx[i]] = concat_fs_matched_idx[i];
     }
   }
 
-  // fill attributes
-  VertexIter vi, vi_end;
-  for (std::tie(vi, vi_end) = vertices(g); vi != vi_end; ++vi) {
-    g[*vi].matched_idx_ = matched_idx[g[*vi].idx_];
-  }
-
 }
 
-void TruthMatcher::compute_matching() {
+const std::vector<int>& TruthMatcher::get_matching() const {
 
-  // initialize result to the empty matching; i.e. all -1. 
-  matching_ = std::vector<int>(num_vertices(reco_graph_), -1);
+  if (!matching_complete_) {
+    for (int u = 0; u < reco_n_vertices_; ++u) { match(u); }
+    matching_complete_ = true;
+  }
 
-  // create color map for dfs
-  std::map<Vertex, boost::default_color_type> color_map;
-  boost::associative_property_map< 
-    std::map<Vertex, boost::default_color_type> > color_pm(color_map);
+  return matching_;
+}
 
-  VertexIter vi, vi_end;
-  for (std::tie(vi, vi_end) = vertices(reco_graph_); vi != vi_end; ++vi) {
-    color_map[*vi] = boost::white_color;
+int TruthMatcher::get_match(int reco_idx) const {
+
+  if (reco_idx < 0 || reco_idx >= reco_n_vertices_) {
+    throw std::out_of_range(
+        "TruthMatcher::get_match(): reco_idx must lie in [0, n_vertices). ");
   }
 
-  // create visitor
-  TruthMatchDfsVisitor vis(matching_, pruned_mc_graph_, pruned_mcidx2vtx_);
+  return match(reco_idx);
+}
 
-  // compute matching by dfs
-  boost::depth_first_search(reco_graph_, visitor(vis).color_map(color_pm));
+bool TruthMatcher::exist_match(const std::vector<int> &reco_idx) const {
+  for (int i : reco_idx) { 
+    if (get_match(i) >= 0) { return true; }
+  }
+  return false;
 }
 
+// compute the match of reco vertex `u`, evaluating only the vertices 
+// it descends to. results are memoized in `matching_`, so candidates 
+// that share daughters evaluate them once. 
+int TruthMatcher::match(int u) const {
 
-void TruthMatchDfsVisitor::finish_vertex(
-    Vertex u, const Graph &reco_graph) {
+  if (matching_[u] != unevaluated_match) { return matching_[u]; }
+
+  // a vertex under evaluation does not match. this only guards 
+  // against cycles; a reco graph should not have any. 
+  matching_[u] = -1;
 
   // for final states, just lookup the answer stored at the node. 
   //
   // be careful though: while it is true that a non-negative matched index 
   // indicates a match to the mc graph, it need not be a match in 
   // the pruned mc graph. 
-  if (is_final_state(reco_graph[u].lund_id_)) {
-    if (reco_graph[u].matched_idx_ >= 0 &&
-        mcidx2vtx_.find(reco_graph[u].matched_idx_) != mcidx2vtx_.end()) {
-      matching_[reco_graph[u].idx_] = reco_graph[u].matched_idx_;
+  if (classifier_.is_final_state(reco_lund_id_[u])) {
+    if (in_pruned_mc_graph(reco_matched_idx_[u])) {
+      matching_[u] = reco_matched_idx_[u];
     }
-
+    return matching_[u];
+  }
 
   // for composite states, it can match only to the common mother of all the 
   // particles that its daughters match to. this amounts to the following 
@@ -495,74 +712,42 @@ void TruthMatchDfsVisitor::finish_vertex(
   // 2. all matched daughters in the mc graph must share the same mother. 
   // 3. that mother must have the same lund id as the composite particle
   // 4. that mother must have the same number of daughter as the composite. 
-  } else {
 
-    // 1. check that all daughters match to a particle in the mc graph.
-    // put the matched mc particles daughter_matched_mcvtx
-    std::vector<Vertex> daughter_matched_mcvtx;
-
-    OutEdgeIter oe, oe_end; 
-    for (std::tie(oe, oe_end) = out_edges(u, reco_graph); 
-        oe != oe_end; ++oe) {
-
-      Vertex v = target(*oe, reco_graph);
-      int daughter_matched_mc_index = matching_[reco_graph[v].idx_];
-
-      // fail if any daughters don't match
-      if (daughter_matched_mc_index < 0) { return; }
-
-      daughter_matched_mcvtx.push_back(
-          mcidx2vtx_.at(daughter_matched_mc_index));
-    }
-
-    if (daughter_matched_mcvtx.size() <= 0) {
-      throw std::runtime_error(
-          "TruthMatchDfsVisitor::finish_vertex(): composite particle has no "
-          "daughters. "
-      );
-    }
-
-
-    // 2. check that all matched mc daughters have a common mother
-    // cache the result of the first daughter, and compare all others
-    // against it. 
-
-    // cache the mother `m` of the first matched daughter. fail if no 
-    // mothers exist. `m` is the common mother if it exists. 
-    InEdgeIter ie, ie_end;
-    std::tie(ie, ie_end) = in_edges(
-        *daughter_matched_mcvtx.begin(), mc_graph_);
-    if (ie == ie_end) { return; }
+  // 1. and 2. check that all daughters match to a particle in the 
+  // mc graph, and that those particles share the mother `m` of the 
+  // first matched daughter. fail if any of them has no mother. 
+  int first = reco_first_daughter_[u], last = reco_first_daughter_[u+1];
+  if (first == last) {
+    throw std::runtime_error(
+        "TruthMatcher::match(): composite particle has no daughters. "
+    );
+  }
 
-    Vertex m = source(*ie, reco_graph);
-    for (auto it = daughter_matched_mcvtx.begin()+1; 
-         it != daughter_matched_mcvtx.end(); ++it) {
-      std::tie(ie, ie_end) = in_edges(*it, mc_graph_);
+  int m = -1;
+  for (int k = first; k < last; ++k) {
 
-      // fail if no mother or if it does not agree with the mother 
-      // of the first daughter
-      if (ie == ie_end) { return; }
-      if (source(*ie, reco_graph) != m) { return; }
-    }
+    int daughter_matched_mc_index = match(reco_daughters_[k]);
 
-    // 3. check for mother lund. fail if it does not agree with the 
-    // lund id of the composite reco particle 
-    if (mc_graph_[m].lund_id_ != reco_graph[u].lund_id_) { return; }
+    // fail if any daughters don't match
+    if (daughter_matched_mc_index < 0) { return -1; }
 
-    // 4. check the number of daughters descending from the common mother
-    size_t n_mc_daughters = 0;
-    for (std::tie(oe, oe_end) = out_edges(m, mc_graph_); oe != oe_end; ++oe) {
-      n_mc_daughters++;
-    }
+    int p = pruned_mc_parent_[daughter_matched_mc_index];
+    if (p < 0) { return -1; }
+    if (k == first) { m = p; } 
+    if (p != m) { return -1; }
+  }
 
-    // fail if it does not have the same number of daughters
-    // as the composite particle
-    if (n_mc_daughters != daughter_matched_mcvtx.size()) { return; }
+  // 3. check for mother lund. fail if it does not agree with the 
+  // lund id of the composite reco particle 
+  if (pruned_mc_lund_id_[m] != reco_lund_id_[u]) { return -1; }
 
-    // success. cache the result
-    matching_[reco_graph[u].idx_] = mc_graph_[m].idx_;
+  // 4. check the number of daughters descending from the common mother. 
+  // fail if it does not have the same number of daughters
+  // as the composite particle
+  if (pruned_mc_n_daughters_[m] != last - first) { return -1; }
 
-  }
+  // success. cache the result
+  matching_[u] = m;
+  return m;
 
 }
-
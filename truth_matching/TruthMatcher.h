@@ -4,20 +4,10 @@
 #include <vector>
 
 #include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/depth_first_search.hpp>
-
-// determine whether a lund id is considered to be 
-// final state for the purpose of truth matching
-bool is_final_state(int lund_id);
-
-// determine whether a lund id is considered to be 
-// undetectable for the purpose of truth matching
-bool is_undetectable_particle(int lund_id);
-
-// determine whether a lund id is considered to be 
-// a valid mother for a photon in truth matching
-bool is_acceptable_photon_mother(int lund_id);
 
+#include <ParticleClassifier.h>
+#include <LruCache.h>
+#include <EventArena.h>
 
 // class that performs truth matching by solving subgraph isomorphism. 
 class TruthMatcher {
@@ -45,14 +35,16 @@ class TruthMatcher {
 
   public:
 
-    // default constructor initializes the truth matcher to a 
-    // state ready to accept inputs
-    TruthMatcher();
+    // initializes the truth matcher to a state ready to accept inputs. 
+    // particles are classified using `classifier`. 
+    TruthMatcher(const ParticleClassifier &classifier);
 
     ~TruthMatcher();
 
-    // load graph information and compute the matching. once set, 
-    // you can call the get methods to access the results. 
+    // load graph information and compute the pruned mc graph. once set, 
+    // you can call the get methods to access the results. matches are 
+    // only computed when requested through get_matching(), get_match() 
+    // or exist_match(). 
     //
     // Input: 
     //
@@ -86,20 +78,59 @@ class TruthMatcher {
         const std::vector<std::vector<int>> &fs_matched_idx
     );
 
+    // same as above, but the mc graph is given in the compressed form 
+    // written by the bta tuple maker: 
+    // + mc_daulen, mc_dauidx: the daughters of mc particle `i` are 
+    //   mc_dauidx[i], ..., mc_dauidx[i]+mc_daulen[i]-1. particles with 
+    //   mc_daulen[i] <= 0 or mc_dauidx[i] <= 0 have no daughters. 
+    // this avoids expanding the mc graph into edge lists. 
+    void set_graph(
+        int mc_n_vertices, 
+        const std::vector<int> &mc_daulen, 
+        const std::vector<int> &mc_dauidx, 
+        const std::vector<int> &mc_lund_id, 
+        int reco_n_vertices, int reco_n_edges, 
+        const std::vector<int> &reco_from_vertices, 
+        const std::vector<int> &reco_to_vertices, 
+        const std::vector<int> &reco_lund_id, 
+        const std::vector<std::vector<int>> &fs_reco_idx,
+        const std::vector<std::vector<int>> &fs_matched_idx
+    );
+
     // get a referece to the mc graph. 
+    // the graph is only built on the first call after set_graph(). 
     Graph get_mc_graph() const;
 
     // get a referece to the pruned mc graph; that is, the graph
     // is the target of matching. 
+    // the graph is only built on the first call after set_graph(). 
     Graph get_pruned_mc_graph() const;
 
+    // get the edges of the pruned mc graph as mc indices. edges are 
+    // ordered by source and then target. cheaper than walking the 
+    // edges of get_pruned_mc_graph(). 
+    void get_pruned_mc_edges(
+        std::vector<int> &from_vertices, 
+        std::vector<int> &to_vertices) const;
+
     // get a referece to the reconstructed graph. 
+    // the graph is only built on the first call after set_graph(). 
     Graph get_reco_graph() const;
 
     // get the result of the matching. value of element `i` indicates the 
     // matched index of reconstructed particle `i`. 
     const std::vector<int>& get_matching() const;
 
+    // get the matched index of reconstructed particle `reco_idx`; -1 if 
+    // it does not match. only the particles it descends to are matched, 
+    // which is much cheaper than get_matching() when few candidates 
+    // are of interest. 
+    int get_match(int reco_idx) const;
+
+    // determine whether any of the reconstructed particles in `reco_idx` 
+    // match. stops at the first that does. 
+    bool exist_match(const std::vector<int> &reco_idx) const;
+
     // get property maps. 
     // prefer to have const... but need to think of a way. to fix!
     IntPropertyMap get_mc_idx_pm();
@@ -110,16 +141,53 @@ class TruthMatcher {
     IntPropertyMap get_reco_lund_id_pm();
     IntPropertyMap get_reco_matched_idx_pm();
 
+    // memoize the pruned mc graph of the `capacity` most recently seen 
+    // mc graph topologies. events that repeat one of them skip pruning. 
+    // a capacity of 0 disables memoization; this is the default. 
+    void set_pruned_mc_cache_size(size_t capacity);
+
+    // number of set_graph() calls that looked up, and that found, 
+    // their mc graph in the pruned mc cache. 
+    size_t pruned_mc_cache_lookups() const { return n_pruned_mc_lookups_; }
+    size_t pruned_mc_cache_hits() const { return n_pruned_mc_hits_; }
+
+    // the temporaries of an event come from an arena that is reused 
+    // across events. with `use_arena` false they are allocated from the 
+    // heap instead; for measuring. call between events. 
+    void set_use_arena(bool use_arena) { arena_.set_bypass(!use_arena); }
+
+  private:
+    // a memoized pruned mc graph. the mc graph is kept to tell 
+    // topologies apart whose hashes collide. 
+    struct PrunedMcEntry {
+      int n_vertices_;
+      std::vector<int> first_daughter_;
+      std::vector<int> daughters_;
+      std::vector<int> lund_id_;
+      std::vector<int> parent_;
+      std::vector<int> n_daughters_;
+    };
+
   private:
     void clear_cache();
 
-    void construct_mc_graph(
+    void load_mc_graph(
         int n_vertices, int n_edges,
         const std::vector<int> &from_vertices, 
         const std::vector<int> &to_vertices, 
         const std::vector<int> &lund_id);
 
-    void construct_reco_graph(
+    void load_mc_graph(
+        int n_vertices, 
+        const std::vector<int> &daulen, 
+        const std::vector<int> &dauidx, 
+        const std::vector<int> &lund_id);
+
+    void build_mc_graph() const;
+    void build_pruned_mc_graph() const;
+    void build_reco_graph() const;
+
+    void load_reco_graph(
         int n_vertices, int n_edges,
         const std::vector<int> &from_vertices, 
         const std::vector<int> &to_vertices, 
@@ -130,95 +198,141 @@ class TruthMatcher {
     void construct_graph(Graph &g, 
         int n_vertices, int n_edges,
         const std::vector<int> &from_vertices, 
-        const std::vector<int> &to_vertices);
+        const std::vector<int> &to_vertices) const;
 
     void populate_lund_id(Graph &g, 
-        const std::vector<int> &lund_id);
+        const std::vector<int> &lund_id) const;
 
-    void populate_reco_matched_idx(Graph &g, int n_vertices,
+    void populate_reco_matched_idx(int n_vertices,
         const std::vector<std::vector<int>> &fs_reco_idx,
         const std::vector<std::vector<int>> &fs_matched_idx);
 
-    void construct_pruned_mc_graph();
-    void remove_final_state_subtrees(Graph &g);
-    void label_for_removal(Vertex, Graph&, std::vector<Vertex>&);
-    void rip_irrelevant_particles(Graph &g);
-
-    void compute_matching();
+    void prune_mc_graph();
+    void prune_mc_graph_memoized();
+    void label_for_removal(int r, 
+        const std::vector<int> &first_daughter, 
+        const std::vector<int> &daughters, 
+        ArenaVector<char> &removed, 
+        ArenaVector<int> &q);
 
-  private:
-    Graph mc_graph_;
-    Graph reco_graph_;
-
-    Graph pruned_mc_graph_;
-    std::unordered_map<int, Vertex> pruned_mcidx2vtx_;
-
-    std::vector<int> matching_;
-                      
-};
+    int match(int u) const;
 
-class TruthMatchDfsVisitor : public boost::default_dfs_visitor {
-
-  public:
-    using Graph = TruthMatcher::Graph;
-    using Vertex = TruthMatcher::Vertex;
-    using InEdgeIter = TruthMatcher::InEdgeIter;
-    using OutEdgeIter = TruthMatcher::OutEdgeIter;
-
-  public: 
-    TruthMatchDfsVisitor(std::vector<int> &matching, const Graph &mc_graph,
-        const std::unordered_map<int, Vertex> &mcidx2vtx) : 
-        matching_(matching), mc_graph_(mc_graph), mcidx2vtx_(mcidx2vtx) {}
-
-    void finish_vertex(Vertex u, const Graph &reco_graph);
+    // true if mc idx `i` is a vertex of the pruned mc graph
+    bool in_pruned_mc_graph(int i) const {
+      return i >= 0 && static_cast<size_t>(i) < pruned_mc_n_daughters_.size() && 
+             pruned_mc_n_daughters_[i] >= 0;
+    }
 
   private:
-    std::vector<int> &matching_;
-    const Graph &mc_graph_;
-    const std::unordered_map<int, Vertex> &mcidx2vtx_;
-
+    ParticleClassifier classifier_;
+
+    // the reco graph as given to set_graph(), and its daughters in 
+    // compressed form: the daughters of vertex `i` are 
+    // reco_daughters_[reco_first_daughter_[i]...reco_first_daughter_[i+1]). 
+    // + reco_matched_idx_: mc idx_ that final state `i` matches to 
+    //   based on the detector hit. -1 if none, or if composite. 
+    int reco_n_vertices_;
+    std::vector<int> reco_from_vertices_;
+    std::vector<int> reco_to_vertices_;
+    std::vector<int> reco_lund_id_;
+    std::vector<int> reco_first_daughter_;
+    std::vector<int> reco_daughters_;
+    std::vector<int> reco_matched_idx_;
+
+    // boost graph of the reco graph. only built on request. 
+    mutable Graph reco_graph_;
+    mutable bool reco_graph_built_;
+
+    // the mc graph as given to set_graph(), in compressed form: the 
+    // daughters of vertex `i` are 
+    // mc_daughters_[mc_first_daughter_[i]...mc_first_daughter_[i+1]). 
+    // mc_parent_[i] is the first mother of `i`; -1 if none. 
+    int mc_n_vertices_;
+    std::vector<int> mc_first_daughter_;
+    std::vector<int> mc_daughters_;
+    std::vector<int> mc_parent_;
+    std::vector<int> mc_lund_id_;
+
+    // boost graphs of the mc and pruned mc graphs. the matching does 
+    // not need them, so they are only built on request. 
+    mutable Graph mc_graph_;
+    mutable Graph pruned_mc_graph_;
+    mutable bool mc_graph_built_;
+    mutable bool pruned_mc_graph_built_;
+
+    // flat view of the pruned mc graph, indexed by mc idx_. the pruned 
+    // graph is a forest, so each vertex has at most one mother. 
+    // + pruned_mc_parent_: mc idx_ of the mother. -1 if none. 
+    // + pruned_mc_n_daughters_: number of daughters. -1 if the vertex 
+    //   is not in the pruned graph. 
+    // + pruned_mc_lund_id_: lund id. 
+    std::vector<int> pruned_mc_parent_;
+    std::vector<int> pruned_mc_n_daughters_;
+    std::vector<int> pruned_mc_lund_id_;
+
+    // memoized matching. entries not yet computed hold 
+    // unevaluated_match. `matching_complete_` is set once all are. 
+    static const int unevaluated_match = -2;
+    mutable std::vector<int> matching_;
+    mutable bool matching_complete_;
+
+    // scratch memory for the temporaries of one event. reset by 
+    // set_graph(). 
+    mutable EventArena arena_;
+
+    // pruned mc graphs keyed by topology_hash(). persists across events. 
+    LruCache<size_t, PrunedMcEntry> pruned_mc_cache_;
+    size_t n_pruned_mc_lookups_;
+    size_t n_pruned_mc_hits_;
+                      
 };
 
 inline TruthMatcher::Graph 
-TruthMatcher::get_mc_graph() const { return mc_graph_; }
+TruthMatcher::get_mc_graph() const { build_mc_graph(); return mc_graph_; }
 
 inline TruthMatcher::IntPropertyMap TruthMatcher::get_mc_idx_pm() { 
+  build_mc_graph();
   return get(&VertexProperties::idx_, mc_graph_); 
 }
 
 inline TruthMatcher::IntPropertyMap TruthMatcher::get_mc_lund_id_pm() { 
+  build_mc_graph();
   return get(&VertexProperties::lund_id_, mc_graph_); 
 }
 
 inline TruthMatcher::Graph 
-TruthMatcher::get_pruned_mc_graph() const { return pruned_mc_graph_; }
+TruthMatcher::get_pruned_mc_graph() const { 
+  build_pruned_mc_graph(); return pruned_mc_graph_; 
+}
 
 inline TruthMatcher::IntPropertyMap 
 TruthMatcher::get_pruned_mc_idx_pm() { 
+  build_pruned_mc_graph();
   return get(&VertexProperties::idx_, pruned_mc_graph_); 
 }
 
 inline TruthMatcher::IntPropertyMap 
 TruthMatcher::get_pruned_mc_lund_id_pm() { 
+  build_pruned_mc_graph();
   return get(&VertexProperties::lund_id_, pruned_mc_graph_); 
 }
 
-inline TruthMatcher::Graph TruthMatcher::get_reco_graph() const { return reco_graph_; }
+inline TruthMatcher::Graph 
+TruthMatcher::get_reco_graph() const { build_reco_graph(); return reco_graph_; }
 
 inline TruthMatcher::IntPropertyMap TruthMatcher::get_reco_idx_pm() { 
+  build_reco_graph();
   return get(&VertexProperties::idx_, reco_graph_); 
 }
 
 inline TruthMatcher::IntPropertyMap TruthMatcher::get_reco_lund_id_pm() { 
+  build_reco_graph();
   return get(&VertexProperties::lund_id_, reco_graph_); 
 }
 
 inline TruthMatcher::IntPropertyMap TruthMatcher::get_reco_matched_idx_pm() { 
+  build_reco_graph();
   return get(&VertexProperties::matched_idx_, reco_graph_); 
 }
 
-inline const std::vector<int>& TruthMatcher::get_matching() const {
-  return matching_;
-}
-
 #endif
@@ -1,11 +1,17 @@
 #include <iostream>
 #include <vector>
+#include <string>
+#include <sstream>
 #include <fstream>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
 
 #include <boost/program_options.hpp>
 
 #include <PsqlReader.h>
 #include <pgstring_convert.h>
+#include <TaskExecutor.h>
 
 #include "ParticleGraphWriter.h"
 #include "TruthMatcher.h"
@@ -13,6 +19,7 @@
 namespace po = boost::program_options;
 
 void compute_truth_match(const po::variables_map &vm);
+void render_batch(const po::variables_map &vm);
 
 int main(int argc, char **argv) {
 
@@ -34,6 +41,9 @@ int main(int argc, char **argv) {
              "table name in the database containing the truth match inforamtion. ")
         ("pdt_fname", po::value<std::string>(), 
              "particle name lookup table file name. ")
+        ("particle_classes_fname", po::value<std::string>()->default_value(
+             "../dat/particle_classes.dat"), 
+             "particle classification file used for truth matching. ")
         ("mcgraph_output", po::value<std::string>(), 
              "file name to print mc graph. ")
         ("pruned_mcgraph_output", po::value<std::string>(), 
@@ -42,6 +52,20 @@ int main(int argc, char **argv) {
              "file name to print reconstruction graph. ")
         ("truth_match_output", po::value<std::string>(), 
              "file name to print truth matched graph. ")
+        ("eids_fname", po::value<std::string>(), 
+             "batch mode: render every event whose eid is listed in this "
+             "file, one or more per line. ")
+        ("min_eid", po::value<int>(), 
+             "batch mode: render events with eid >= min_eid. ")
+        ("max_eid", po::value<int>(), 
+             "batch mode: render events with eid < max_eid. ")
+        ("batch_output_prefix", po::value<std::string>()->default_value(""), 
+             "batch mode: prefix of the output file names. ")
+        ("batch_single_file", po::value<bool>()->default_value(false), 
+             "batch mode: write each kind of graph for all events into one "
+             "multi-graph file instead of one file per event. ")
+        ("n_threads", po::value<int>()->default_value(0), 
+             "batch mode: number of rendering threads. 0 uses one per core. ")
     ;
 
     po::options_description hidden("Hidden options");
@@ -85,7 +109,11 @@ int main(int argc, char **argv) {
     notify(vm);
 
     // compute truth match
-    compute_truth_match(vm);
+    if (vm.count("eids_fname") || vm.count("min_eid") || vm.count("max_eid")) {
+      render_batch(vm);
+    } else {
+      compute_truth_match(vm);
+    }
 
   } catch(std::exception& e) {
 
@@ -100,26 +128,20 @@ int main(int argc, char **argv) {
   return 0;
 }
 
-void compute_truth_match(const po::variables_map &vm) {
-
-
-  // open database connection and populate fields
-  std::string dbname = vm["dbname"].as<std::string>();
-  std::string table_name = vm["table_name"].as<std::string>();
-
-  PsqlReader psql;
-  psql.open_connection("dbname=" + dbname);
-  psql.open_cursor(table_name, 
-      { "eid", 
-        "mc_n_vertices", "mc_n_edges", 
-        "mc_from_vertices", "mc_to_vertices", "mc_lund_id",
-        "reco_n_vertices", "reco_n_edges", 
-        "reco_from_vertices", "reco_to_vertices", "reco_lund_id", 
-        "h_reco_idx", "hmcidx", 
-        "l_reco_idx", "lmcidx", 
-        "gamma_reco_idx", "gammamcidx"});
-
-
+// columns of the truth match input table. 
+const std::vector<std::string> record_columns = {
+  "eid", 
+  "mc_n_vertices", "mc_n_edges", 
+  "mc_from_vertices", "mc_to_vertices", "mc_lund_id",
+  "reco_n_vertices", "reco_n_edges", 
+  "reco_from_vertices", "reco_to_vertices", "reco_lund_id", 
+  "h_reco_idx", "hmcidx", 
+  "l_reco_idx", "lmcidx", 
+  "gamma_reco_idx", "gammamcidx"
+};
+
+// one row of the truth match input table. 
+struct Record {
   int eid;
   int mc_n_vertices, mc_n_edges;
   std::vector<int> mc_from_vertices, mc_to_vertices, mc_lund_id;
@@ -128,89 +150,237 @@ void compute_truth_match(const po::variables_map &vm) {
   std::vector<int> h_reco_idx, hmcidx;
   std::vector<int> l_reco_idx, lmcidx;
   std::vector<int> gamma_reco_idx, gammamcidx;
+};
+
+// graphviz text of the four graphs of one record. 
+struct RenderedRecord {
+  std::string mcgraph;
+  std::string pruned_mcgraph;
+  std::string recograph;
+  std::string truth_match;
+};
+
+void read_record(const PsqlReader &psql, Record &r) {
+  pgstring_convert(psql.get("eid"), r.eid);
+  pgstring_convert(psql.get("mc_n_vertices"), r.mc_n_vertices);
+  pgstring_convert(psql.get("mc_n_edges"), r.mc_n_edges);
+  pgstring_convert(psql.get("mc_from_vertices"), r.mc_from_vertices);
+  pgstring_convert(psql.get("mc_to_vertices"), r.mc_to_vertices);
+  pgstring_convert(psql.get("mc_lund_id"), r.mc_lund_id);
+  pgstring_convert(psql.get("reco_n_vertices"), r.reco_n_vertices);
+  pgstring_convert(psql.get("reco_n_edges"), r.reco_n_edges);
+  pgstring_convert(psql.get("reco_from_vertices"), r.reco_from_vertices);
+  pgstring_convert(psql.get("reco_to_vertices"), r.reco_to_vertices);
+  pgstring_convert(psql.get("reco_lund_id"), r.reco_lund_id);
+  pgstring_convert(psql.get("h_reco_idx"), r.h_reco_idx);
+  pgstring_convert(psql.get("hmcidx"), r.hmcidx);
+  pgstring_convert(psql.get("l_reco_idx"), r.l_reco_idx);
+  pgstring_convert(psql.get("lmcidx"), r.lmcidx);
+  pgstring_convert(psql.get("gamma_reco_idx"), r.gamma_reco_idx);
+  pgstring_convert(psql.get("gammamcidx"), r.gammamcidx);
+}
 
-  int record_idx = vm["record_idx"].as<int>();
-  bool valid_record = true;
-  for (int i = 0; i <= record_idx && (valid_record=psql.next()); ++i) ;
-
-  if (!valid_record) {
-    std::string s = "database table does not contain at least ";
-    s += std::to_string(record_idx+1) + " records. ";
-    throw std::runtime_error(s);
-  }
+// compute the truth match of `r` with `tm` and print its graphs. 
+// only reads the shared arguments, so threads may call it concurrently 
+// with their own TruthMatcher. 
+void render_record(
+    const Record &r, TruthMatcher &tm, 
+    const std::string &pdt_fname, const TruthMatchGraphPrinter &tm_printer, 
+    RenderedRecord &out) {
 
-  pgstring_convert(psql.get("eid"), eid);
-  pgstring_convert(psql.get("mc_n_vertices"), mc_n_vertices);
-  pgstring_convert(psql.get("mc_n_edges"), mc_n_edges);
-  pgstring_convert(psql.get("mc_from_vertices"), mc_from_vertices);
-  pgstring_convert(psql.get("mc_to_vertices"), mc_to_vertices);
-  pgstring_convert(psql.get("mc_lund_id"), mc_lund_id);
-  pgstring_convert(psql.get("reco_n_vertices"), reco_n_vertices);
-  pgstring_convert(psql.get("reco_n_edges"), reco_n_edges);
-  pgstring_convert(psql.get("reco_from_vertices"), reco_from_vertices);
-  pgstring_convert(psql.get("reco_to_vertices"), reco_to_vertices);
-  pgstring_convert(psql.get("reco_lund_id"), reco_lund_id);
-  pgstring_convert(psql.get("h_reco_idx"), h_reco_idx);
-  pgstring_convert(psql.get("hmcidx"), hmcidx);
-  pgstring_convert(psql.get("l_reco_idx"), l_reco_idx);
-  pgstring_convert(psql.get("lmcidx"), lmcidx);
-  pgstring_convert(psql.get("gamma_reco_idx"), gamma_reco_idx);
-  pgstring_convert(psql.get("gammamcidx"), gammamcidx);
-
-  
-  // compute truth match
-  TruthMatcher tm;
   tm.set_graph(
-      mc_n_vertices, mc_n_edges,
-      mc_from_vertices, mc_to_vertices,
-      mc_lund_id, 
-      reco_n_vertices, reco_n_edges,
-      reco_from_vertices, reco_to_vertices,
-      reco_lund_id, 
-      { h_reco_idx, l_reco_idx, gamma_reco_idx }, 
-      { hmcidx, lmcidx, gammamcidx }
+      r.mc_n_vertices, r.mc_n_edges,
+      r.mc_from_vertices, r.mc_to_vertices,
+      r.mc_lund_id, 
+      r.reco_n_vertices, r.reco_n_edges,
+      r.reco_from_vertices, r.reco_to_vertices,
+      r.reco_lund_id, 
+      { r.h_reco_idx, r.l_reco_idx, r.gamma_reco_idx }, 
+      { r.hmcidx, r.lmcidx, r.gammamcidx }
   );
 
-  // print graphs to file
-  std::string pdt_fname = vm["pdt_fname"].as<std::string>();
-  std::string mcgraph_output = vm["mcgraph_output"].as<std::string>();
-  std::string pruned_mcgraph_output = vm["pruned_mcgraph_output"].as<std::string>();
-  std::string recograph_output = vm["recograph_output"].as<std::string>();
-  std::string truth_match_output = vm["truth_match_output"].as<std::string>();
-  std::ofstream fout;
+  std::ostringstream os;
 
   // print mc graph
-  fout.open(mcgraph_output);
   auto mcgraph_writer = make_lund_id_writer(tm.get_mc_lund_id_pm(), pdt_fname);
   mcgraph_writer.set_property("color", "blue");
-  print_graph(fout, tm.get_mc_graph(), tm.get_mc_idx_pm(), mcgraph_writer);
-  fout.close();
+  print_graph(os, tm.get_mc_graph(), tm.get_mc_idx_pm(), mcgraph_writer);
+  out.mcgraph = os.str(); os.str("");
 
   // print pruned mc graph
-  fout.open(pruned_mcgraph_output);
   auto pruned_mcgraph_writer = 
     make_lund_id_writer(tm.get_pruned_mc_lund_id_pm(), pdt_fname);
   pruned_mcgraph_writer.set_property("color", "blue");
-  print_graph(fout, tm.get_pruned_mc_graph(), 
+  print_graph(os, tm.get_pruned_mc_graph(), 
       tm.get_pruned_mc_idx_pm(), pruned_mcgraph_writer);
-  fout.close();
+  out.pruned_mcgraph = os.str(); os.str("");
 
   // print reco graph
-  fout.open(recograph_output);
   auto reco_writer = make_lund_id_writer(tm.get_reco_lund_id_pm(), pdt_fname);
   reco_writer.set_property("color", "red");
-  print_graph(fout, tm.get_reco_graph(), tm.get_reco_idx_pm(), reco_writer);
-  fout.close();
+  print_graph(os, tm.get_reco_graph(), tm.get_reco_idx_pm(), reco_writer);
+  out.recograph = os.str(); os.str("");
 
   // print truth match
-  TruthMatchGraphPrinter tm_printer(pdt_fname);
-  fout.open(truth_match_output);
-  tm_printer.print(fout, tm.get_reco_graph(), tm.get_matching(), 
+  tm_printer.print(os, tm.get_reco_graph(), tm.get_matching(), 
                    tm.get_reco_idx_pm(), tm.get_reco_lund_id_pm());
+  out.truth_match = os.str();
+}
+
+void write_file(const std::string &fname, const std::string &contents) {
+  std::ofstream fout(fname);
+  fout << contents;
   fout.close();
+  if (!fout) { throw std::runtime_error("cannot write " + fname + ". "); }
+}
+
+void compute_truth_match(const po::variables_map &vm) {
+
+
+  // open database connection and populate fields
+  std::string dbname = vm["dbname"].as<std::string>();
+  std::string table_name = vm["table_name"].as<std::string>();
+
+  PsqlReader psql;
+  psql.open_connection("dbname=" + dbname);
+  psql.open_cursor(table_name, record_columns);
+
+  int record_idx = vm["record_idx"].as<int>();
+  bool valid_record = true;
+  for (int i = 0; i <= record_idx && (valid_record=psql.next()); ++i) ;
+
+  if (!valid_record) {
+    std::string s = "database table does not contain at least ";
+    s += std::to_string(record_idx+1) + " records. ";
+    throw std::runtime_error(s);
+  }
+
+  Record r;
+  read_record(psql, r);
+
+  // compute truth match and print graphs to file
+  ParticleClassifier classifier(vm["particle_classes_fname"].as<std::string>());
+
+  std::string pdt_fname = vm["pdt_fname"].as<std::string>();
+  TruthMatcher tm(classifier);
+  TruthMatchGraphPrinter tm_printer(pdt_fname);
+
+  RenderedRecord out;
+  render_record(r, tm, pdt_fname, tm_printer, out);
+
+  write_file(vm["mcgraph_output"].as<std::string>(), out.mcgraph);
+  write_file(vm["pruned_mcgraph_output"].as<std::string>(), out.pruned_mcgraph);
+  write_file(vm["recograph_output"].as<std::string>(), out.recograph);
+  write_file(vm["truth_match_output"].as<std::string>(), out.truth_match);
 
   // close database connection
   psql.close_cursor();
   psql.close_connection();
 
 }
+
+// render all selected events. records are read in eid order a chunk at 
+// a time; each chunk is rendered in parallel and written out in order as 
+// the renderings complete. 
+void render_batch(const po::variables_map &vm) {
+
+  std::string dbname = vm["dbname"].as<std::string>();
+  std::string table_name = vm["table_name"].as<std::string>();
+  std::string pdt_fname = vm["pdt_fname"].as<std::string>();
+  std::string prefix = vm["batch_output_prefix"].as<std::string>();
+  bool single_file = vm["batch_single_file"].as<bool>();
+
+  TaskExecutor executor(std::max(vm["n_threads"].as<int>(), 0));
+  int n_threads = executor.n_workers();
+
+  // select the events in the cursor query
+  std::string where_clause;
+  std::vector<std::string> params;
+  if (vm.count("min_eid")) {
+    append_predicate(where_clause, params, "eid >=", 
+                     std::to_string(vm["min_eid"].as<int>()));
+  }
+  if (vm.count("max_eid")) {
+    append_predicate(where_clause, params, "eid <", 
+                     std::to_string(vm["max_eid"].as<int>()));
+  }
+  if (vm.count("eids_fname")) {
+    std::string fname = vm["eids_fname"].as<std::string>();
+    std::ifstream fin(fname);
+    if (!fin.is_open()) { 
+      throw std::runtime_error("cannot open " + fname + ". "); 
+    }
+    std::vector<int> eids;
+    for (int eid; fin >> eid; ) { eids.push_back(eid); }
+
+    // the list is bound as a single array parameter
+    params.push_back(vector2pgstring(eids));
+    if (!where_clause.empty()) { where_clause += " AND "; }
+    where_clause += "eid = ANY($" + std::to_string(params.size()) + ")";
+  }
+
+  PsqlReader psql;
+  psql.open_connection("dbname=" + dbname);
+  psql.open_cursor(table_name, record_columns, where_clause, params, "eid");
+
+  ParticleClassifier classifier(vm["particle_classes_fname"].as<std::string>());
+  TruthMatchGraphPrinter tm_printer(pdt_fname);
+
+  std::vector<TruthMatcher> matchers(n_threads, TruthMatcher(classifier));
+
+  // in single file mode, each kind of graph goes to one file
+  std::ofstream mc_fout, pruned_mc_fout, reco_fout, tm_fout;
+  if (single_file) {
+    mc_fout.open(prefix + "mcgraph.gv");
+    pruned_mc_fout.open(prefix + "pruned_mcgraph.gv");
+    reco_fout.open(prefix + "recograph.gv");
+    tm_fout.open(prefix + "truthmatch.gv");
+  }
+
+  size_t chunk_size = 64 * n_threads;
+  std::vector<Record> records(chunk_size);
+  std::vector<RenderedRecord> rendered(chunk_size);
+
+  size_t n_records = 0;
+  bool more = true;
+  while (more) {
+
+    // read a chunk
+    size_t n = 0;
+    while (n < chunk_size && (more = psql.next())) { 
+      read_record(psql, records[n++]); 
+    }
+    if (n == 0) { break; }
+
+    // render it in parallel and write it out in eid order. the first 
+    // exception is rethrown here. 
+    executor.parallel_for_ordered(n, 1, 
+      [&] (int worker, size_t i) {
+        render_record(records[i], matchers[worker], 
+                      pdt_fname, tm_printer, rendered[i]);
+      }, 
+      [&] (size_t i) {
+        if (single_file) {
+          mc_fout << rendered[i].mcgraph;
+          pruned_mc_fout << rendered[i].pruned_mcgraph;
+          reco_fout << rendered[i].recograph;
+          tm_fout << rendered[i].truth_match;
+        } else {
+          std::string event = prefix + std::to_string(records[i].eid) + "_";
+          write_file(event + "mcgraph.gv", rendered[i].mcgraph);
+          write_file(event + "pruned_mcgraph.gv", rendered[i].pruned_mcgraph);
+          write_file(event + "recograph.gv", rendered[i].recograph);
+          write_file(event + "truthmatch.gv", rendered[i].truth_match);
+        }
+      });
+
+    n_records += n;
+  }
+
+  // close database connection
+  psql.close_cursor();
+  psql.close_connection();
+
+  std::cout << "rendered " << n_records << " events. " << std::endl;
+
+}
@@ -0,0 +1,287 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <PsqlReader.h>
+#include <cursor_options.h>
+#include <pgstring_convert.h>
+
+#include <boost/program_options.hpp>
+
+#include "TruthMatcher.h"
+#include "TensorShardWriter.h"
+
+namespace po = boost::program_options;
+
+void export_training_tensors(const po::variables_map &vm);
+
+int main(int argc, char **argv) {
+
+  try {
+
+    // define program options
+    po::options_description generic("Generic options");
+    generic.add_options()
+        ("help,h", "produce help message")
+    ;
+
+    po::options_description config("Configuration options");
+    config.add_options()
+        ("dbname", po::value<std::string>(),
+             "database name. ")
+        ("table_name", po::value<std::string>(),
+             "name of the table containing the graphs and truth match "
+             "inputs. ")
+        ("output_prefix", po::value<std::string>(),
+             "prefix of the output .npy files and the manifest. ")
+        ("block_names", po::value<std::string>()
+             ->default_value("y b d c h l gamma"),
+             "reco blocks in the order of the global reconstruction "
+             "index. vertices listed in <name>_reco_idx get block id "
+             "equal to the position of <name> in this list. ")
+        ("shard_size", po::value<int>()->default_value(4096),
+             "number of events per shard. ")
+        ("min_padded_vertices", po::value<int>()->default_value(16),
+             "smallest padded vertex count. larger buckets double it. ")
+        ("mc_graph_format", po::value<std::string>()->default_value("edges"),
+             "format of the mc graph columns. edges: mc_n_edges, "
+             "mc_from_vertices, mc_to_vertices. csr: mc_daulen, mc_dauidx. ")
+        ("pruned_mc_cache_size", po::value<int>()->default_value(1024),
+             "number of distinct mc graph topologies whose pruned "
+             "graphs are memoized. 0 disables memoization. ")
+        ("particle_classes_fname", po::value<std::string>()->default_value(
+             "../dat/particle_classes.dat"),
+             "particle classification file used for truth matching. ")
+    ;
+    add_cursor_options(config);
+
+    po::options_description hidden("Hidden options");
+    hidden.add_options()
+        ("config_file", po::value<std::string>(),
+             "name of a configuration file. ")
+    ;
+
+    po::options_description cmdline_options;
+    cmdline_options.add(generic).add(config).add(hidden);
+
+    po::options_description config_file_options;
+    config_file_options.add(config);
+
+    po::options_description visible;
+    visible.add(generic).add(config);
+
+    po::positional_options_description p;
+    p.add("config_file", -1);
+
+    // parse program options and configuration file
+    po::variables_map vm;
+    store(po::command_line_parser(argc, argv).
+          options(cmdline_options).positional(p).run(), vm);
+    notify(vm);
+
+    if (vm.count("help") || !vm.count("config_file")) {
+      std::cout << std::endl;
+      std::cout << "Usage: ./export_training_tensors ";
+      std::cout << "[options] config_fname" << std::endl;
+      std::cout << visible << "\n";
+      return 0;
+    }
+
+    std::ifstream fin(vm["config_file"].as<std::string>());
+    if (!fin) {
+      std::cout << "cannot open config file: ";
+      std::cout << vm["config_file"].as<std::string>() << std::endl;
+      return 0;
+    }
+
+    store(parse_config_file(fin, config_file_options), vm);
+    notify(vm);
+
+    // main routine
+    export_training_tensors(vm);
+
+  } catch(std::exception& e) {
+
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+
+  } catch(...) {
+
+    std::cerr << "Exception of unknown type!\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+// position of `name` in `block_names`. throws if it is not listed.
+int block_index(const std::vector<std::string> &block_names,
+                const std::string &name) {
+  auto it = std::find(block_names.begin(), block_names.end(), name);
+  if (it == block_names.end()) {
+    throw std::invalid_argument(
+        "export_training_tensors(): block_names must include " + name + ". ");
+  }
+  return it - block_names.begin();
+}
+
+void export_training_tensors(const po::variables_map &vm) {
+
+  std::string dbname = vm["dbname"].as<std::string>();
+  std::string table_name = vm["table_name"].as<std::string>();
+  int cursor_fetch_size = vm["cursor_fetch_size"].as<int>();
+
+  std::string mc_graph_format = vm["mc_graph_format"].as<std::string>();
+  if (mc_graph_format != "edges" && mc_graph_format != "csr") {
+    throw std::invalid_argument(
+        "export_training_tensors(): mc_graph_format must be one of "
+        "edges or csr. ");
+  }
+  bool mc_csr = (mc_graph_format == "csr");
+
+  std::vector<std::string> block_names;
+  std::istringstream block_iss(vm["block_names"].as<std::string>());
+  for (std::string name; block_iss >> name; ) { block_names.push_back(name); }
+  if (block_names.size() > 127) {
+    throw std::invalid_argument(
+        "export_training_tensors(): at most 127 blocks are supported. ");
+  }
+
+  // the final state blocks are needed for truth matching
+  int h_block = block_index(block_names, "h");
+  int l_block = block_index(block_names, "l");
+  int gamma_block = block_index(block_names, "gamma");
+
+  PsqlReader psql;
+  psql.open_connection("dbname="+dbname);
+
+  // restrict the query to an eid shard when requested
+  std::string where_clause;
+  std::vector<std::string> params;
+  append_eid_range(vm, where_clause, params);
+
+  configure_cursor(psql, vm);
+
+  std::vector<std::string> columns = { "eid" };
+  if (mc_csr) {
+    columns.insert(columns.end(),
+        { "mc_n_vertices", "mc_daulen", "mc_dauidx", "mc_lund_id" });
+  } else {
+    columns.insert(columns.end(),
+        { "mc_n_vertices", "mc_n_edges",
+          "mc_from_vertices", "mc_to_vertices", "mc_lund_id" });
+  }
+  columns.insert(columns.end(),
+      { "reco_n_vertices", "reco_n_edges",
+        "reco_from_vertices", "reco_to_vertices", "reco_lund_id",
+        "hmcidx", "lmcidx", "gammamcidx" });
+  for (const auto &name : block_names) {
+    columns.push_back(name + "_reco_idx");
+  }
+
+  psql.open_cursor(table_name, columns,
+      where_clause, params, "", -1, cursor_fetch_size);
+
+  int eid;
+  int mc_n_vertices, mc_n_edges = 0;
+  std::vector<int> mc_from_vertices, mc_to_vertices, mc_lund_id;
+  std::vector<int> mc_daulen, mc_dauidx;
+  int reco_n_vertices, reco_n_edges;
+  std::vector<int> reco_from_vertices, reco_to_vertices, reco_lund_id;
+  std::vector<int> hmcidx, lmcidx, gammamcidx;
+  std::vector<std::vector<int>> block_reco_idx(block_names.size());
+  std::vector<int> block_id;
+
+  // the particle classification is loaded once and shared by all records
+  ParticleClassifier classifier(vm["particle_classes_fname"].as<std::string>());
+  TruthMatcher tm(classifier);
+  tm.set_pruned_mc_cache_size(vm["pruned_mc_cache_size"].as<int>());
+
+  TensorShardWriter writer(
+      vm["output_prefix"].as<std::string>(),
+      vm["shard_size"].as<int>(), vm["min_padded_vertices"].as<int>());
+
+  // main loop
+  size_t n_records = 0;
+  while (psql.next()) {
+
+    ++n_records;
+
+    // load record information
+    pgstring_convert(psql.get("eid"), eid);
+    pgstring_convert(psql.get("mc_n_vertices"), mc_n_vertices);
+    if (mc_csr) {
+      pgstring_convert(psql.get("mc_daulen"), mc_daulen);
+      pgstring_convert(psql.get("mc_dauidx"), mc_dauidx);
+    } else {
+      pgstring_convert(psql.get("mc_n_edges"), mc_n_edges);
+      pgstring_convert(psql.get("mc_from_vertices"), mc_from_vertices);
+      pgstring_convert(psql.get("mc_to_vertices"), mc_to_vertices);
+    }
+    pgstring_convert(psql.get("mc_lund_id"), mc_lund_id);
+    pgstring_convert(psql.get("reco_n_vertices"), reco_n_vertices);
+    pgstring_convert(psql.get("reco_n_edges"), reco_n_edges);
+    pgstring_convert(psql.get("reco_from_vertices"), reco_from_vertices);
+    pgstring_convert(psql.get("reco_to_vertices"), reco_to_vertices);
+    pgstring_convert(psql.get("reco_lund_id"), reco_lund_id);
+    pgstring_convert(psql.get("hmcidx"), hmcidx);
+    pgstring_convert(psql.get("lmcidx"), lmcidx);
+    pgstring_convert(psql.get("gammamcidx"), gammamcidx);
+    for (size_t b = 0; b < block_names.size(); ++b) {
+      pgstring_convert(psql.get(block_names[b] + "_reco_idx"),
+                       block_reco_idx[b]);
+    }
+
+    // label every reco vertex with its matched mc index
+    if (mc_csr) {
+      tm.set_graph(
+          mc_n_vertices, mc_daulen, mc_dauidx, mc_lund_id,
+          reco_n_vertices, reco_n_edges,
+          reco_from_vertices, reco_to_vertices,
+          reco_lund_id,
+          { block_reco_idx[h_block], block_reco_idx[l_block],
+            block_reco_idx[gamma_block] },
+          { hmcidx, lmcidx, gammamcidx }
+      );
+    } else {
+      tm.set_graph(
+          mc_n_vertices, mc_n_edges,
+          mc_from_vertices, mc_to_vertices,
+          mc_lund_id,
+          reco_n_vertices, reco_n_edges,
+          reco_from_vertices, reco_to_vertices,
+          reco_lund_id,
+          { block_reco_idx[h_block], block_reco_idx[l_block],
+            block_reco_idx[gamma_block] },
+          { hmcidx, lmcidx, gammamcidx }
+      );
+    }
+
+    // block id of every reco vertex
+    block_id.assign(reco_n_vertices, -1);
+    for (size_t b = 0; b < block_names.size(); ++b) {
+      for (int v : block_reco_idx[b]) {
+        if (v >= 0 && v < reco_n_vertices) { block_id[v] = b; }
+      }
+    }
+
+    writer.add(eid, reco_n_vertices, reco_n_edges,
+               reco_from_vertices, reco_to_vertices,
+               reco_lund_id, block_id, tm.get_matching());
+
+  }
+
+  writer.close();
+
+  // close database connection
+  psql.close_cursor();
+  psql.close_connection();
+
+  std::cout << "exported " << n_records << " rows in ";
+  std::cout << writer.n_shards() << " shards. " << std::endl;
+
+}
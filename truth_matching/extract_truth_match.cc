@@ -1,9 +1,18 @@
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <sstream>
+#include <memory>
+#include <algorithm>
 
 #include <PsqlReader.h>
+#include <extraction_state.h>
+#include <cursor_options.h>
+#include <ExtractionCheckpoint.h>
 #include <pgstring_convert.h>
+#include <CompressedOfstream.h>
+#include <compression.h>
+#include <BoundedPipeline.h>
 
 #include <boost/program_options.hpp>
 
@@ -21,6 +30,7 @@ int main(int argc, char **argv) {
     po::options_description generic("Generic options");
     generic.add_options()
         ("help,h", "produce help message")
+        ("resume", "resume an interrupted run from its last checkpoint. ")
     ;
 
     po::options_description config("Configuration options");
@@ -31,9 +41,35 @@ int main(int argc, char **argv) {
              "name of the table containing the truth match inputs. ")
         ("output_fname", po::value<std::string>(), 
              "output csv file name to store extracted result. ")
-        ("cursor_fetch_size", po::value<int>()->default_value(5000), 
-             "number of rows per cursor fetch. ")
+        ("state_table", po::value<std::string>(), 
+             "if set, run incrementally: only extract records past the "
+             "high-water eid recorded in this table. ")
+        ("state_key", po::value<std::string>()->default_value("truth_match"), 
+             "key of the high-water eid in state_table. ")
+        ("checkpoint_interval", po::value<int>()->default_value(0), 
+             "number of records between checkpoints. 0 disables them. ")
+        ("match_mode", po::value<std::string>()->default_value("full"), 
+             "what to match. full: every reco particle. y: only the y "
+             "candidates. exist_y: only whether some y candidate matches. "
+             "columns that are not computed are written as NULL. ")
+        ("mc_graph_format", po::value<std::string>()->default_value("edges"), 
+             "format of the mc graph columns. edges: mc_n_edges, "
+             "mc_from_vertices, mc_to_vertices. csr: mc_daulen, mc_dauidx, "
+             "as written by extract_mcgraph with output_format = csr. ")
+        ("pruned_mc_cache_size", po::value<int>()->default_value(1024), 
+             "number of distinct mc graph topologies whose pruned "
+             "graphs are memoized. 0 disables memoization. ")
+        ("particle_classes_fname", po::value<std::string>()->default_value(
+             "../dat/particle_classes.dat"), 
+             "particle classification file used for truth matching. ")
+        ("n_threads", po::value<int>()->default_value(1), 
+             "number of truth matching threads. reading and writing "
+             "run on threads of their own. ")
+        ("memory_budget_mb", po::value<int>()->default_value(256), 
+             "cap in MiB on the fetched rows and the records read but "
+             "not yet written. the reader waits when it is reached. ")
     ;
+    add_cursor_options(config);
 
     po::options_description hidden("Hidden options");
     hidden.add_options()
@@ -94,29 +130,12 @@ int main(int argc, char **argv) {
   return 0;
 }
 
-void extract_truth_match(const po::variables_map &vm) {
-
-  // open database connection and populate fields
-  std::string dbname = vm["dbname"].as<std::string>();
-  std::string table_name = vm["table_name"].as<std::string>();
-  int cursor_fetch_size = vm["cursor_fetch_size"].as<int>();
-
-  PsqlReader psql;
-  psql.open_connection("dbname="+dbname);
-  psql.open_cursor(table_name, 
-      { "eid", 
-        "mc_n_vertices", "mc_n_edges", 
-        "mc_from_vertices", "mc_to_vertices", "mc_lund_id",
-        "reco_n_vertices", "reco_n_edges", 
-        "reco_from_vertices", "reco_to_vertices", "reco_lund_id", 
-        "h_reco_idx", "hmcidx", 
-        "l_reco_idx", "lmcidx", 
-        "gamma_reco_idx", "gammamcidx", 
-        "y_reco_idx"}, cursor_fetch_size);
-
+// columns of one truth match input record
+struct Record {
   int eid;
-  int mc_n_vertices, mc_n_edges;
+  int mc_n_vertices, mc_n_edges = 0;
   std::vector<int> mc_from_vertices, mc_to_vertices, mc_lund_id;
+  std::vector<int> mc_daulen, mc_dauidx;
   int reco_n_vertices, reco_n_edges;
   std::vector<int> reco_from_vertices, reco_to_vertices, reco_lund_id;
   std::vector<int> h_reco_idx, hmcidx;
@@ -124,88 +143,292 @@ void extract_truth_match(const po::variables_map &vm) {
   std::vector<int> gamma_reco_idx, gammamcidx;
   std::vector<int> y_reco_idx;
 
-  // open output file and write title line
-  std::string output_fname = vm["output_fname"].as<std::string>();
-  std::ofstream fout; fout.open(output_fname);
-  fout << "eid,pruned_mc_from_vertices,pruned_mc_to_vertices,";
-  fout << "matching,y_match_status,exist_matched_y" << std::endl;
+  // bytes held by the record, for the memory budget
+  size_t bytes() const {
+    size_t n = 0;
+    for (const auto *v : { &mc_from_vertices, &mc_to_vertices, &mc_lund_id, 
+                           &mc_daulen, &mc_dauidx, 
+                           &reco_from_vertices, &reco_to_vertices, 
+                           &reco_lund_id, &h_reco_idx, &hmcidx, 
+                           &l_reco_idx, &lmcidx, &gamma_reco_idx, 
+                           &gammamcidx, &y_reco_idx }) {
+      n += v->capacity();
+    }
+    return sizeof(Record) + n * sizeof(int);
+  }
+};
 
-  // main loop
-  size_t n_records = 0;
-  while (psql.next()) {
-
-    ++n_records;
-
-    // load record information
-    pgstring_convert(psql.get("eid"), eid);
-    pgstring_convert(psql.get("mc_n_vertices"), mc_n_vertices);
-    pgstring_convert(psql.get("mc_n_edges"), mc_n_edges);
-    pgstring_convert(psql.get("mc_from_vertices"), mc_from_vertices);
-    pgstring_convert(psql.get("mc_to_vertices"), mc_to_vertices);
-    pgstring_convert(psql.get("mc_lund_id"), mc_lund_id);
-    pgstring_convert(psql.get("reco_n_vertices"), reco_n_vertices);
-    pgstring_convert(psql.get("reco_n_edges"), reco_n_edges);
-    pgstring_convert(psql.get("reco_from_vertices"), reco_from_vertices);
-    pgstring_convert(psql.get("reco_to_vertices"), reco_to_vertices);
-    pgstring_convert(psql.get("reco_lund_id"), reco_lund_id);
-    pgstring_convert(psql.get("h_reco_idx"), h_reco_idx);
-    pgstring_convert(psql.get("hmcidx"), hmcidx);
-    pgstring_convert(psql.get("l_reco_idx"), l_reco_idx);
-    pgstring_convert(psql.get("lmcidx"), lmcidx);
-    pgstring_convert(psql.get("gamma_reco_idx"), gamma_reco_idx);
-    pgstring_convert(psql.get("gammamcidx"), gammamcidx);
-    pgstring_convert(psql.get("y_reco_idx"), y_reco_idx);
-
-    
-    // compute truth match
-    TruthMatcher tm;
+// output line of one record
+struct Result {
+  int eid;
+  std::string line;
+};
+
+// load the next record from the cursor. returns false once it is exhausted. 
+bool read_record(PsqlReader &psql, bool mc_csr, Record &r) {
+
+  if (!psql.next()) { return false; }
+
+  pgstring_convert(psql.get("eid"), r.eid);
+  pgstring_convert(psql.get("mc_n_vertices"), r.mc_n_vertices);
+  if (mc_csr) {
+    pgstring_convert(psql.get("mc_daulen"), r.mc_daulen);
+    pgstring_convert(psql.get("mc_dauidx"), r.mc_dauidx);
+  } else {
+    pgstring_convert(psql.get("mc_n_edges"), r.mc_n_edges);
+    pgstring_convert(psql.get("mc_from_vertices"), r.mc_from_vertices);
+    pgstring_convert(psql.get("mc_to_vertices"), r.mc_to_vertices);
+  }
+  pgstring_convert(psql.get("mc_lund_id"), r.mc_lund_id);
+  pgstring_convert(psql.get("reco_n_vertices"), r.reco_n_vertices);
+  pgstring_convert(psql.get("reco_n_edges"), r.reco_n_edges);
+  pgstring_convert(psql.get("reco_from_vertices"), r.reco_from_vertices);
+  pgstring_convert(psql.get("reco_to_vertices"), r.reco_to_vertices);
+  pgstring_convert(psql.get("reco_lund_id"), r.reco_lund_id);
+  pgstring_convert(psql.get("h_reco_idx"), r.h_reco_idx);
+  pgstring_convert(psql.get("hmcidx"), r.hmcidx);
+  pgstring_convert(psql.get("l_reco_idx"), r.l_reco_idx);
+  pgstring_convert(psql.get("lmcidx"), r.lmcidx);
+  pgstring_convert(psql.get("gamma_reco_idx"), r.gamma_reco_idx);
+  pgstring_convert(psql.get("gammamcidx"), r.gammamcidx);
+  pgstring_convert(psql.get("y_reco_idx"), r.y_reco_idx);
+
+  return true;
+}
+
+// truth match a record and format its output line. matches are only 
+// computed for the particles that the match mode asks for. 
+void match_record(TruthMatcher &tm, const std::string &match_mode, 
+                  bool mc_csr, const Record &r, Result &result) {
+
+  if (mc_csr) {
+    tm.set_graph(
+        r.mc_n_vertices, r.mc_daulen, r.mc_dauidx, r.mc_lund_id, 
+        r.reco_n_vertices, r.reco_n_edges,
+        r.reco_from_vertices, r.reco_to_vertices,
+        r.reco_lund_id, 
+        { r.h_reco_idx, r.l_reco_idx, r.gamma_reco_idx }, 
+        { r.hmcidx, r.lmcidx, r.gammamcidx }
+    );
+  } else {
     tm.set_graph(
-        mc_n_vertices, mc_n_edges,
-        mc_from_vertices, mc_to_vertices,
-        mc_lund_id, 
-        reco_n_vertices, reco_n_edges,
-        reco_from_vertices, reco_to_vertices,
-        reco_lund_id, 
-        { h_reco_idx, l_reco_idx, gamma_reco_idx }, 
-        { hmcidx, lmcidx, gammamcidx }
+        r.mc_n_vertices, r.mc_n_edges,
+        r.mc_from_vertices, r.mc_to_vertices,
+        r.mc_lund_id, 
+        r.reco_n_vertices, r.reco_n_edges,
+        r.reco_from_vertices, r.reco_to_vertices,
+        r.reco_lund_id, 
+        { r.h_reco_idx, r.l_reco_idx, r.gamma_reco_idx }, 
+        { r.hmcidx, r.lmcidx, r.gammamcidx }
     );
+  }
 
-    // compute from and to vertices of pruned mc graph
-    std::vector<int> from_vertices, to_vertices;
-    TruthMatcher::Graph pruned_mcgraph = tm.get_pruned_mc_graph();
-    boost::graph_traits<TruthMatcher::Graph>::edge_iterator ei, ei_end;
-    for (std::tie(ei, ei_end) = edges(pruned_mcgraph); ei != ei_end; ++ei) {
-      from_vertices.push_back(
-          pruned_mcgraph[source(*ei, pruned_mcgraph)].idx_);
-      to_vertices.push_back(
-          pruned_mcgraph[target(*ei, pruned_mcgraph)].idx_);
-    }
+  // compute from and to vertices of pruned mc graph
+  std::vector<int> from_vertices, to_vertices;
+  tm.get_pruned_mc_edges(from_vertices, to_vertices);
+
+  std::ostringstream os;
+  os << r.eid << ",";
+  os << vector2pgstring(from_vertices) << ",";
+  os << vector2pgstring(to_vertices) << ",";
+
+  if (match_mode == "exist_y") {
+
+    // stops at the first matched y candidate
+    os << ",,";
+    os << (tm.exist_match(r.y_reco_idx) ? 1 : 0);
 
-    // get matching result
-    std::vector<int> matching = tm.get_matching();
+  } else {
 
     // get y matched status and set indicator
     int exist_matched_y = 0;
-    std::vector<int> y_match_status(y_reco_idx.size(), -1);
-    for (size_t i = 0; i < y_reco_idx.size(); ++i) {
-      if (matching[y_reco_idx[i]] >= 0) {
+    std::vector<int> y_match_status(r.y_reco_idx.size(), -1);
+    for (size_t i = 0; i < r.y_reco_idx.size(); ++i) {
+      if (tm.get_match(r.y_reco_idx[i]) >= 0) {
         y_match_status[i] = 1;
         exist_matched_y = 1;
       }
     }
 
-    // write a line
-    fout << eid << ",";
-    fout << vector2pgstring(from_vertices) << ",";
-    fout << vector2pgstring(to_vertices) << ",";
-    fout << vector2pgstring(matching) << ",";
-    fout << vector2pgstring(y_match_status) << ",";
-    fout << exist_matched_y;
-    fout << std::endl;
+    if (match_mode == "full") { 
+      os << vector2pgstring(tm.get_matching()); 
+    }
+    os << ",";
+    os << vector2pgstring(y_match_status) << ",";
+    os << exist_matched_y;
+  }
+
+  os << "\n";
+
+  result.eid = r.eid;
+  result.line = os.str();
+}
+
+void extract_truth_match(const po::variables_map &vm) {
+
+  // open database connection and populate fields
+  std::string dbname = vm["dbname"].as<std::string>();
+  std::string table_name = vm["table_name"].as<std::string>();
+  int cursor_fetch_size = vm["cursor_fetch_size"].as<int>();
+
+  std::string match_mode = vm["match_mode"].as<std::string>();
+  if (match_mode != "full" && match_mode != "y" && match_mode != "exist_y") {
+    throw std::invalid_argument(
+        "extract_truth_match(): match_mode must be one of "
+        "full, y or exist_y. ");
+  }
+
+  std::string mc_graph_format = vm["mc_graph_format"].as<std::string>();
+  if (mc_graph_format != "edges" && mc_graph_format != "csr") {
+    throw std::invalid_argument(
+        "extract_truth_match(): mc_graph_format must be one of "
+        "edges or csr. ");
+  }
+  bool mc_csr = (mc_graph_format == "csr");
+
+  PsqlReader psql;
+  psql.open_connection("dbname="+dbname);
+
+  // restrict the query to an eid shard when requested
+  std::string where_clause;
+  std::vector<std::string> params;
+  append_eid_range(vm, where_clause, params);
+
+  // in incremental mode, skip records that were already loaded
+  int high_water_eid;
+  if (vm.count("state_table") && 
+      read_high_water_eid(psql, vm["state_table"].as<std::string>(), 
+                          vm["state_key"].as<std::string>(), high_water_eid)) {
+    append_predicate(where_clause, params, "eid >", 
+                     std::to_string(high_water_eid));
+    std::cout << "incremental mode: extracting records with eid > ";
+    std::cout << high_water_eid << ". " << std::endl;
+  }
+
+  // checkpoints are kept next to the output file. records are read in 
+  // eid order so that a resumed run continues after the last saved eid. 
+  std::string output_fname = vm["output_fname"].as<std::string>();
+  int checkpoint_interval = vm["checkpoint_interval"].as<int>();
+  ExtractionCheckpoint ckpt(output_fname + ".ckpt");
+
+  bool resume = vm.count("resume");
+
+  // compressed output cannot be truncated back to a checkpoint
+  bool compress = is_compressed_fname(output_fname);
+  if (compress && (resume || checkpoint_interval > 0)) {
+    throw std::invalid_argument(
+        "extract_truth_match(): checkpoints require uncompressed output. ");
+  }
+  if (resume) {
+    if (!ckpt.load()) {
+      throw std::runtime_error(
+          "cannot resume: no checkpoint found for " + output_fname + ". ");
+    }
+    append_predicate(where_clause, params, "eid >", 
+                     std::to_string(ckpt.last_eid()));
+    std::cout << "resuming after eid " << ckpt.last_eid() << ". " << std::endl;
+  }
+
+  std::string order_by;
+  if (resume || checkpoint_interval > 0) { order_by = "eid"; }
+
+  // the memory budget holds the fetched rows as well as the records in 
+  // flight, so a fetch may take at most half of it 
+  if (vm["memory_budget_mb"].as<int>() <= 0) {
+    throw std::invalid_argument(
+        "extract_truth_match(): memory_budget_mb must be positive. ");
+  }
+  size_t memory_budget = size_t(vm["memory_budget_mb"].as<int>()) << 20;
+
+  int adaptive_fetch_mb = vm["adaptive_fetch_mb"].as<int>();
+  if (adaptive_fetch_mb > 0 && 
+      (size_t(adaptive_fetch_mb) << 20) > memory_budget / 2) {
+    throw std::invalid_argument(
+        "extract_truth_match(): adaptive_fetch_mb must be at most half "
+        "of memory_budget_mb. ");
+  }
+  configure_cursor(psql, vm, memory_budget / 2);
+
+  std::vector<std::string> mc_columns;
+  if (mc_csr) {
+    mc_columns = { "mc_n_vertices", "mc_daulen", "mc_dauidx", "mc_lund_id" };
+  } else {
+    mc_columns = { "mc_n_vertices", "mc_n_edges", 
+                   "mc_from_vertices", "mc_to_vertices", "mc_lund_id" };
   }
 
-  // close file
-  fout.close();
+  std::vector<std::string> columns = { "eid" };
+  columns.insert(columns.end(), mc_columns.begin(), mc_columns.end());
+  columns.insert(columns.end(), 
+      { "reco_n_vertices", "reco_n_edges", 
+        "reco_from_vertices", "reco_to_vertices", "reco_lund_id", 
+        "h_reco_idx", "hmcidx", 
+        "l_reco_idx", "lmcidx", 
+        "gamma_reco_idx", "gammamcidx", 
+        "y_reco_idx" });
+
+  psql.open_cursor(table_name, columns, 
+      where_clause, params, order_by, -1, cursor_fetch_size);
+
+  // open output file and write title line. when resuming, discard 
+  // anything written after the checkpoint and append to the rest. 
+  std::ofstream plain_fout; 
+  CompressedOfstream compressed_fout;
+  std::ostream &fout = compress ? 
+    static_cast<std::ostream&>(compressed_fout) : plain_fout;
+  size_t n_records = 0;
+  if (resume) {
+    ckpt.truncate(output_fname);
+    plain_fout.open(output_fname, std::ios::app);
+    n_records = ckpt.n_records();
+  } else {
+    // a checkpoint left by an earlier run does not describe this output
+    ckpt.remove();
+    if (compress) { 
+      compressed_fout.open(output_fname); 
+    } else { 
+      plain_fout.open(output_fname); 
+    }
+    fout << "eid,pruned_mc_from_vertices,pruned_mc_to_vertices,";
+    fout << "matching,y_match_status,exist_matched_y" << std::endl;
+  }
+
+  // the particle classification is loaded once and shared by all records
+  ParticleClassifier classifier(vm["particle_classes_fname"].as<std::string>());
+  // one truth matcher per thread; each memoizes its own pruned mc graphs
+  int n_threads = vm["n_threads"].as<int>();
+  std::vector<std::unique_ptr<TruthMatcher>> tms;
+  for (int i = 0; i < n_threads; ++i) {
+    tms.emplace_back(new TruthMatcher(classifier));
+    tms.back()->set_pruned_mc_cache_size(vm["pruned_mc_cache_size"].as<int>());
+  }
+
+  // main loop: read, match and write records on separate threads, with 
+  // the fetched rows and the records in between held to the memory budget 
+  BoundedPipeline<Record, Result> pipeline(memory_budget, n_threads);
+  pipeline.run(
+      [&] (Record &r) { 
+        bool more = read_record(psql, mc_csr, r); 
+        pipeline.reserve(psql.fetch_bytes());
+        return more; },
+      [&] (int worker, Record &r, Result &result) { 
+        match_record(*tms[worker], match_mode, mc_csr, r, result); },
+      [&] (Result &result) {
+        ++n_records;
+        fout << result.line;
+
+        // record progress
+        if (checkpoint_interval > 0 && n_records % checkpoint_interval == 0) {
+          ckpt.save(result.eid, fout, n_records);
+        }
+      },
+      [] (const Record &r) { return r.bytes(); },
+      [] (const Result &result) { 
+        return sizeof(Result) + result.line.capacity(); });
+
+  // close file. the run is complete, so the checkpoint is obsolete. 
+  if (compress) { compressed_fout.close(); } else { plain_fout.close(); }
+  ckpt.remove();
 
   // close database connection
   psql.close_cursor();
@@ -213,4 +436,19 @@ void extract_truth_match(const po::variables_map &vm) {
 
   std::cout << "processed " << n_records << " rows. " << std::endl;
 
+  size_t lookups = 0, hits = 0;
+  for (const auto &tm : tms) {
+    lookups += tm->pruned_mc_cache_lookups();
+    hits += tm->pruned_mc_cache_hits();
+  }
+  if (lookups > 0) {
+    std::cout << "pruned mc cache: " << hits;
+    std::cout << " hits in " << lookups << " lookups (";
+    std::cout << 100.0 * hits / lookups;
+    std::cout << "%). " << std::endl;
+  }
+
+  std::cout << "peak memory in flight: ";
+  std::cout << (pipeline.peak_bytes() >> 10) << " KiB. " << std::endl;
+
 }
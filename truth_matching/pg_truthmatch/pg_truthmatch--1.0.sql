@@ -0,0 +1,34 @@
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION pg_truthmatch" to load this file. \quit
+
+-- columns of the truth_match table, without the eid. 
+CREATE TYPE truth_match_result AS (
+  pruned_mc_from_vertices integer[],
+  pruned_mc_to_vertices integer[],
+  matching integer[],
+  y_match_status integer[],
+  exist_matched_y integer
+);
+
+-- truth match a row with the columns of truth_match_input. the mc graph 
+-- may be given as mc_daulen and mc_dauidx instead of edge lists. 
+-- `match_mode` is one of full, y or exist_y, as in extract_truth_match; 
+-- columns that are not computed are NULL. returns NULL if the row has no 
+-- reco graph, e.g. when build_recograph() skipped it for a full block. 
+--
+-- particles are classified with the file named by the superuser 
+-- setting pg_truthmatch.particle_classes_fname, by default the copy of 
+-- dat/particle_classes.dat installed with the extension. 
+--
+-- each backend memoizes the pruned mc graphs of recently seen 
+-- topologies, so the function is cheapest on rows of a single mc sample. 
+-- the extension requires postgres 9.6 or later. 
+CREATE FUNCTION truth_match(row_data record, match_mode text)
+RETURNS truth_match_result
+AS 'MODULE_PATHNAME', 'truth_match'
+LANGUAGE C STRICT STABLE PARALLEL SAFE;
+
+CREATE FUNCTION truth_match(row_data record)
+RETURNS truth_match_result
+AS $$ SELECT truth_match($1, 'full'); $$
+LANGUAGE SQL STRICT STABLE PARALLEL SAFE;
@@ -0,0 +1,348 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <exception>
+#include <stdexcept>
+
+#include "TruthMatcher.h"
+
+extern "C" {
+#include <postgres.h>
+#include <fmgr.h>
+#include <funcapi.h>
+#include <miscadmin.h>
+#include <access/htup_details.h>
+#include <catalog/pg_type.h>
+#include <utils/array.h>
+#include <utils/builtins.h>
+#include <utils/guc.h>
+#include <utils/typcache.h>
+
+PG_MODULE_MAGIC;
+
+void _PG_init(void);
+
+PG_FUNCTION_INFO_V1(truth_match);
+Datum truth_match(PG_FUNCTION_ARGS);
+}
+
+// server side version of extract_truth_match: truth_match(row, mode)
+// computes the truth match of one row of the truth match inputs and
+// returns the columns of the truth_match table, without the eid.
+//
+// as in pg_recograph, postgres errors longjmp past c++ destructors and
+// c++ exceptions must not unwind through postgres frames. a call
+// alternates between postgres sections, which detoast the columns into
+// palloc'd buffers while no c++ object with a destructor is alive, and
+// c++ sections run by run_guarded(), which touch only those buffers and
+// the static cache.
+//
+// particles are classified with the file named by the superuser setting
+// pg_truthmatch.particle_classes_fname. by default it is the copy of
+// dat/particle_classes.dat installed with the extension, so editing the
+// matching rules needs no rebuild; the file is read again whenever the
+// setting changes.
+
+// value of pg_truthmatch.particle_classes_fname
+static char *particle_classes_fname = NULL;
+
+void _PG_init(void) {
+  DefineCustomStringVariable(
+      "pg_truthmatch.particle_classes_fname",
+      "Particle classification file used by truth_match().",
+      "Empty for the pg_truthmatch_particle_classes.dat installed in "
+      "the extension directory.",
+      &particle_classes_fname, "", PGC_SUSET, 0, NULL, NULL, NULL);
+}
+
+namespace {
+
+// input columns of a row, as in truth_match_input. the mc graph is read
+// from mc_daulen and mc_dauidx when the row has them, and from the edge
+// lists otherwise; the columns of the other format may be absent.
+const std::vector<std::string> column_names = {
+  "mc_n_vertices", "mc_n_edges", "mc_from_vertices", "mc_to_vertices",
+  "mc_daulen", "mc_dauidx", "mc_lund_id",
+  "reco_n_vertices", "reco_n_edges", "reco_from_vertices",
+  "reco_to_vertices", "reco_lund_id",
+  "h_reco_idx", "hmcidx", "l_reco_idx", "lmcidx",
+  "gamma_reco_idx", "gammamcidx", "y_reco_idx"
+};
+
+enum Column {
+  MC_N_VERTICES, MC_N_EDGES, MC_FROM, MC_TO, MC_DAULEN, MC_DAUIDX, MC_LUND_ID,
+  RECO_N_VERTICES, RECO_N_EDGES, RECO_FROM, RECO_TO, RECO_LUND_ID,
+  H_RECO_IDX, HMCIDX, L_RECO_IDX, LMCIDX,
+  GAMMA_RECO_IDX, GAMMAMCIDX, Y_RECO_IDX,
+  N_COLUMNS
+};
+
+struct CallCache {
+  std::string particle_classes_fname;
+  std::unique_ptr<TruthMatcher> tm;
+  Oid row_type = InvalidOid;
+  int32 row_typmod = -1;
+  bool mc_csr = false;
+  std::vector<int> attnums;
+  std::vector<std::vector<int>> columns;
+
+  // result of the current row
+  std::vector<int> from_vertices, to_vertices;
+  std::vector<int> matching, y_match_status;
+  bool has_matching = false, has_y_match_status = false;
+  int exist_matched_y = 0;
+};
+
+CallCache cache;
+
+// integer or integer[] column detoasted into plain memory. an absent or
+// null column has no elements.
+struct IntColumn {
+  const int32 *data;
+  int n;
+};
+
+// run `f`, a c++ section, and report the exception it throws, if any,
+// as a postgres error after it has unwound.
+template <typename F>
+void run_guarded(F f) {
+  char errmsg_buf[512] = "";
+  try {
+    f();
+  } catch (std::exception &e) {
+    strlcpy(errmsg_buf, e.what(), sizeof(errmsg_buf));
+  } catch (...) {
+    strlcpy(errmsg_buf, "unknown exception. ", sizeof(errmsg_buf));
+  }
+  if (errmsg_buf[0] != '\0') {
+    cache.row_type = InvalidOid;
+    ereport(ERROR,
+        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+         errmsg("truth_match(): %s", errmsg_buf)));
+  }
+}
+
+// c++ section: load the particle classification if the file changed.
+void set_particle_classes(const char *fname) {
+  if (!cache.tm || cache.particle_classes_fname != fname) {
+    cache.tm.reset();
+    cache.tm.reset(new TruthMatcher(ParticleClassifier(fname)));
+    cache.tm->set_pruned_mc_cache_size(1024);
+    cache.particle_classes_fname = fname;
+  }
+}
+
+int find_column(TupleDesc tupdesc, const std::string &colname) {
+  for (int i = 0; i < tupdesc->natts; ++i) {
+    Form_pg_attribute att = TupleDescAttr(tupdesc, i);
+    if (!att->attisdropped && colname == NameStr(att->attname)) { return i; }
+  }
+  return -1;
+}
+
+// c++ section: position of every input column in the row type; -1 if
+// absent.
+void bind_columns(TupleDesc tupdesc) {
+  cache.mc_csr = find_column(tupdesc, "mc_daulen") >= 0;
+
+  cache.attnums.clear();
+  for (int c = 0; c < N_COLUMNS; ++c) {
+    const std::string &colname = column_names[c];
+    int attnum = find_column(tupdesc, colname);
+    bool optional = cache.mc_csr ?
+      (c == MC_N_EDGES || c == MC_FROM || c == MC_TO) :
+      (c == MC_DAULEN || c == MC_DAUIDX);
+    if (attnum < 0 && !optional) {
+      throw std::invalid_argument("row has no column " + colname + ". ");
+    }
+    if (attnum >= 0) {
+      Oid type = TupleDescAttr(tupdesc, attnum)->atttypid;
+      if (type != INT4OID && type != INT4ARRAYOID) {
+        throw std::invalid_argument(
+            "column " + colname + " must be integer or integer[]. ");
+      }
+    }
+    cache.attnums.push_back(attnum);
+  }
+  cache.columns.resize(N_COLUMNS);
+}
+
+// postgres section: the column at `attnum` of the deformed row. scalar
+// columns become a single element.
+IntColumn decode_column(
+    int attnum, TupleDesc tupdesc, Datum *values, bool *nulls) {
+
+  IntColumn col = { NULL, 0 };
+  if (attnum < 0 || nulls[attnum]) { return col; }
+
+  Form_pg_attribute att = TupleDescAttr(tupdesc, attnum);
+  if (att->atttypid == INT4OID) {
+    int32 *v = static_cast<int32*>(palloc(sizeof(int32)));
+    *v = DatumGetInt32(values[attnum]);
+    col.data = v;
+    col.n = 1;
+    return col;
+  }
+
+  ArrayType *arr = DatumGetArrayTypeP(values[attnum]);
+  if (ARR_NDIM(arr) > 1 || ARR_HASNULL(arr)) {
+    ereport(ERROR,
+        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+         errmsg("truth_match(): column %s must be one dimensional "
+                "without nulls. ", NameStr(att->attname))));
+  }
+  col.data = reinterpret_cast<const int32*>(ARR_DATA_PTR(arr));
+  col.n = ArrayGetNItems(ARR_NDIM(arr), ARR_DIMS(arr));
+  return col;
+}
+
+int scalar(int c) {
+  if (cache.columns[c].size() != 1) {
+    throw std::invalid_argument("scalar input column is null. ");
+  }
+  return cache.columns[c][0];
+}
+
+// c++ section: truth match the row with the decoded `columns`. returns
+// false if the row has no reco graph, e.g. one that build_recograph
+// skipped for a full block.
+bool match_row(const IntColumn *columns, const std::string &match_mode) {
+
+  for (int c = 0; c < N_COLUMNS; ++c) {
+    cache.columns[c].assign(columns[c].data, columns[c].data + columns[c].n);
+  }
+  if (cache.columns[RECO_N_VERTICES].empty()) { return false; }
+
+  const std::vector<std::vector<int>> &col = cache.columns;
+  TruthMatcher &tm = *cache.tm;
+
+  if (cache.mc_csr) {
+    tm.set_graph(
+        scalar(MC_N_VERTICES), col[MC_DAULEN], col[MC_DAUIDX], col[MC_LUND_ID],
+        scalar(RECO_N_VERTICES), scalar(RECO_N_EDGES),
+        col[RECO_FROM], col[RECO_TO], col[RECO_LUND_ID],
+        { col[H_RECO_IDX], col[L_RECO_IDX], col[GAMMA_RECO_IDX] },
+        { col[HMCIDX], col[LMCIDX], col[GAMMAMCIDX] });
+  } else {
+    tm.set_graph(
+        scalar(MC_N_VERTICES), scalar(MC_N_EDGES),
+        col[MC_FROM], col[MC_TO], col[MC_LUND_ID],
+        scalar(RECO_N_VERTICES), scalar(RECO_N_EDGES),
+        col[RECO_FROM], col[RECO_TO], col[RECO_LUND_ID],
+        { col[H_RECO_IDX], col[L_RECO_IDX], col[GAMMA_RECO_IDX] },
+        { col[HMCIDX], col[LMCIDX], col[GAMMAMCIDX] });
+  }
+
+  tm.get_pruned_mc_edges(cache.from_vertices, cache.to_vertices);
+
+  // same columns as extract_truth_match for each match mode
+  const std::vector<int> &y_reco_idx = col[Y_RECO_IDX];
+  cache.has_matching = (match_mode == "full");
+  if (cache.has_matching) { cache.matching = tm.get_matching(); }
+  cache.has_y_match_status = (match_mode != "exist_y");
+  if (match_mode == "exist_y") {
+    cache.exist_matched_y = tm.exist_match(y_reco_idx) ? 1 : 0;
+  } else {
+    cache.exist_matched_y = 0;
+    cache.y_match_status.assign(y_reco_idx.size(), -1);
+    for (size_t i = 0; i < y_reco_idx.size(); ++i) {
+      if (tm.get_match(y_reco_idx[i]) >= 0) {
+        cache.y_match_status[i] = 1;
+        cache.exist_matched_y = 1;
+      }
+    }
+  }
+  return true;
+}
+
+ArrayType* int_array(const std::vector<int> &v) {
+  Datum *elems = static_cast<Datum*>(palloc(sizeof(Datum) * (v.size()+1)));
+  for (size_t i = 0; i < v.size(); ++i) { elems[i] = Int32GetDatum(v[i]); }
+  return construct_array(elems, v.size(), INT4OID, 4, true, 'i');
+}
+
+}
+
+Datum truth_match(PG_FUNCTION_ARGS) {
+
+  HeapTupleHeader row = PG_GETARG_HEAPTUPLEHEADER(0);
+  char *match_mode = text_to_cstring(PG_GETARG_TEXT_PP(1));
+  if (strcmp(match_mode, "full") != 0 && strcmp(match_mode, "y") != 0 &&
+      strcmp(match_mode, "exist_y") != 0) {
+    ereport(ERROR,
+        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+         errmsg("truth_match(): match_mode must be one of "
+                "full, y or exist_y. ")));
+  }
+
+  Oid row_type = HeapTupleHeaderGetTypeId(row);
+  int32 row_typmod = HeapTupleHeaderGetTypMod(row);
+  TupleDesc tupdesc = lookup_rowtype_tupdesc(row_type, row_typmod);
+
+  HeapTupleData tuple;
+  tuple.t_len = HeapTupleHeaderGetDatumLength(row);
+  ItemPointerSetInvalid(&(tuple.t_self));
+  tuple.t_tableOid = InvalidOid;
+  tuple.t_data = row;
+
+  Datum *values = static_cast<Datum*>(palloc(tupdesc->natts * sizeof(Datum)));
+  bool *nulls = static_cast<bool*>(palloc(tupdesc->natts * sizeof(bool)));
+  heap_deform_tuple(&tuple, tupdesc, values, nulls);
+
+  char classes_fname[MAXPGPATH];
+  if (particle_classes_fname == NULL || particle_classes_fname[0] == '\0') {
+    char share_path[MAXPGPATH];
+    get_share_path(my_exec_path, share_path);
+    snprintf(classes_fname, sizeof(classes_fname),
+             "%s/extension/pg_truthmatch_particle_classes.dat", share_path);
+  } else {
+    strlcpy(classes_fname, particle_classes_fname, sizeof(classes_fname));
+  }
+
+  run_guarded([&] () {
+    set_particle_classes(classes_fname);
+    if (row_type != cache.row_type || row_typmod != cache.row_typmod) {
+      bind_columns(tupdesc);
+      cache.row_type = row_type;
+      cache.row_typmod = row_typmod;
+    }
+  });
+
+  IntColumn *columns =
+    static_cast<IntColumn*>(palloc(sizeof(IntColumn) * N_COLUMNS));
+  for (int c = 0; c < N_COLUMNS; ++c) {
+    columns[c] = decode_column(cache.attnums[c], tupdesc, values, nulls);
+  }
+  ReleaseTupleDesc(tupdesc);
+
+  bool has_match = false;
+  run_guarded([&] () { has_match = match_row(columns, match_mode); });
+  if (!has_match) { PG_RETURN_NULL(); }
+
+  TupleDesc result_desc;
+  if (get_call_result_type(fcinfo, NULL, &result_desc) != TYPEFUNC_COMPOSITE) {
+    ereport(ERROR,
+        (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+         errmsg("truth_match(): must return the truth_match_result type. ")));
+  }
+  result_desc = BlessTupleDesc(result_desc);
+
+  Datum result[5];
+  bool result_nulls[5] = { false, false, false, false, false };
+  result[0] = PointerGetDatum(int_array(cache.from_vertices));
+  result[1] = PointerGetDatum(int_array(cache.to_vertices));
+  if (cache.has_matching) {
+    result[2] = PointerGetDatum(int_array(cache.matching));
+  } else {
+    result_nulls[2] = true;
+  }
+  if (cache.has_y_match_status) {
+    result[3] = PointerGetDatum(int_array(cache.y_match_status));
+  } else {
+    result_nulls[3] = true;
+  }
+  result[4] = Int32GetDatum(cache.exist_matched_y);
+
+  PG_RETURN_DATUM(
+      HeapTupleGetDatum(heap_form_tuple(result_desc, result, result_nulls)));
+}
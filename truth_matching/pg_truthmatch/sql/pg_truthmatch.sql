@@ -0,0 +1,80 @@
+CREATE EXTENSION pg_truthmatch;
+-- fixture: truth_match_input.csv holds two events with the mc graph as 
+-- edge lists, one whose y candidate matches and one with an unmatched 
+-- pion, and eid 3 without a reco graph. truth_match_input_csr.csv holds 
+-- the first two with the mc graph as mc_daulen and mc_dauidx. 
+-- truth_match_<mode>.csv is the output of extract_truth_match for the 
+-- edges input in each match mode (data/extract_truth_match.cfg). 
+CREATE TABLE truth_match_input (
+  eid integer,
+  mc_n_vertices integer, mc_n_edges integer,
+  mc_from_vertices integer[], mc_to_vertices integer[], mc_lund_id integer[],
+  reco_n_vertices integer, reco_n_edges integer,
+  reco_from_vertices integer[], reco_to_vertices integer[],
+  reco_lund_id integer[],
+  h_reco_idx integer[], hmcidx integer[], l_reco_idx integer[],
+  lmcidx integer[], gamma_reco_idx integer[], gammamcidx integer[],
+  y_reco_idx integer[]
+);
+\copy truth_match_input FROM 'data/truth_match_input.csv' WITH CSV HEADER
+CREATE TABLE truth_match_input_csr (
+  eid integer,
+  mc_n_vertices integer, mc_daulen integer[], mc_dauidx integer[],
+  mc_lund_id integer[],
+  reco_n_vertices integer, reco_n_edges integer,
+  reco_from_vertices integer[], reco_to_vertices integer[],
+  reco_lund_id integer[],
+  h_reco_idx integer[], hmcidx integer[], l_reco_idx integer[],
+  lmcidx integer[], gamma_reco_idx integer[], gammamcidx integer[],
+  y_reco_idx integer[]
+);
+\copy truth_match_input_csr FROM 'data/truth_match_input_csr.csv' WITH CSV HEADER
+CREATE TABLE extract_truth_match (
+  eid integer,
+  pruned_mc_from_vertices integer[], pruned_mc_to_vertices integer[],
+  matching integer[], y_match_status integer[], exist_matched_y integer
+);
+CREATE TABLE extract_truth_match_y (LIKE extract_truth_match);
+CREATE TABLE extract_truth_match_exist_y (LIKE extract_truth_match);
+\copy extract_truth_match FROM 'data/truth_match_full.csv' WITH CSV HEADER
+\copy extract_truth_match_y FROM 'data/truth_match_y.csv' WITH CSV HEADER
+\copy extract_truth_match_exist_y FROM 'data/truth_match_exist_y.csv' WITH CSV HEADER
+CREATE VIEW expected AS
+SELECT i.input, 'full'::text AS mode, e.* FROM extract_truth_match AS e,
+  unnest(ARRAY['edges', 'csr']) AS i(input)
+UNION ALL
+SELECT i.input, 'y', e.* FROM extract_truth_match_y AS e,
+  unnest(ARRAY['edges', 'csr']) AS i(input)
+UNION ALL
+SELECT i.input, 'exist_y', e.* FROM extract_truth_match_exist_y AS e,
+  unnest(ARRAY['edges', 'csr']) AS i(input);
+CREATE TABLE server AS
+SELECT 'edges'::text AS input, m.mode, t.eid, r.*
+FROM truth_match_input AS t, unnest(ARRAY['full', 'y', 'exist_y']) AS m(mode),
+     LATERAL truth_match(t, m.mode) AS r
+WHERE t.reco_n_vertices IS NOT NULL
+UNION ALL
+SELECT 'csr', m.mode, t.eid, r.*
+FROM truth_match_input_csr AS t, unnest(ARRAY['full', 'y', 'exist_y']) AS m(mode),
+     LATERAL truth_match(t, m.mode) AS r;
+-- rows without a reco graph, and null rows, give NULL
+SELECT t.eid, truth_match(t, 'full') IS NULL AS no_match
+FROM truth_match_input AS t
+ORDER BY t.eid;
+SELECT truth_match(NULL::truth_match_input, 'y') IS NULL AS null_row;
+-- rows that differ from extract_truth_match, or are missing on either side
+SELECT input, mode, eid
+FROM server AS s FULL JOIN expected AS e USING (input, mode, eid)
+WHERE (s.pruned_mc_from_vertices, s.pruned_mc_to_vertices, s.matching,
+       s.y_match_status, s.exist_matched_y) IS DISTINCT FROM
+      (e.pruned_mc_from_vertices, e.pruned_mc_to_vertices, e.matching,
+       e.y_match_status, e.exist_matched_y)
+ORDER BY input, mode, eid;
+SELECT input, mode, count(*) AS n_compared,
+       sum(exist_matched_y) AS n_matched_y,
+       count(matching) AS n_matching, count(y_match_status) AS n_y_status
+FROM server
+GROUP BY input, mode
+ORDER BY input, mode;
+-- unknown match modes are reported
+SELECT truth_match(t, 'partial') FROM truth_match_input AS t WHERE t.eid = 1;
@@ -0,0 +1,26 @@
+-- incremental counterpart of populate_truth_match_template.sql. loads 
+-- the output of extract_truth_match run with `state_table = extraction_state`, 
+-- replaces any existing rows for the same eid's, and advances the 
+-- high-water eid in the same transaction. 
+BEGIN;
+
+CREATE TEMPORARY TABLE truth_match_new (
+  eid integer,
+  pruned_mc_from_vertices integer[],
+  pruned_mc_to_vertices integer[],
+  matching integer[],
+  y_match_status integer[],
+  exist_matched_y integer
+) ON COMMIT DROP;
+
+\copy truth_match_new FROM 'truth_match.csv' WITH CSV HEADER;
+
+DELETE FROM truth_match USING truth_match_new 
+WHERE truth_match.eid = truth_match_new.eid;
+
+INSERT INTO truth_match SELECT * FROM truth_match_new;
+
+DELETE FROM extraction_state WHERE state_key = 'truth_match';
+INSERT INTO extraction_state SELECT 'truth_match', max(eid) FROM truth_match;
+
+COMMIT;
@@ -0,0 +1,30 @@
+-- server side counterpart of extract_truth_match followed by 
+-- populate_truth_match_template.sql. uses the pg_truthmatch extension, 
+-- so neither the truth_match_input view nor the csv round trip is needed. 
+BEGIN;
+
+CREATE EXTENSION IF NOT EXISTS pg_truthmatch;
+
+-- the function is called in FROM so that it runs once per record. the 
+-- graph columns are passed through as loaded, so this works on graph 
+-- tables with mc edge lists (populate_graph_tables_template.sql) as well 
+-- as with csr mc graphs (populate_graph_tables_csr_template.sql). 
+-- on postgres 9.6 or later the scan runs in parallel. 
+CREATE TABLE truth_match AS 
+SELECT t.eid, m.*
+FROM (
+  SELECT g.*, f.hmcidx, f.lmcidx, f.gammamcidx
+  FROM framework_ntuples AS f INNER JOIN graph AS g USING (eid)
+) AS t, LATERAL truth_match(t, 'full') AS m;
+
+CREATE INDEX ON truth_match (eid);
+
+CREATE TABLE IF NOT EXISTS extraction_state (
+  state_key text PRIMARY KEY,
+  max_eid integer
+);
+
+DELETE FROM extraction_state WHERE state_key = 'truth_match';
+INSERT INTO extraction_state SELECT 'truth_match', max(eid) FROM truth_match;
+
+COMMIT;
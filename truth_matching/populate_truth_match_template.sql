@@ -15,4 +15,12 @@ DROP MATERIALIZED VIEW truth_match_input;
 
 CREATE INDEX ON truth_match (eid);
 
+CREATE TABLE IF NOT EXISTS extraction_state (
+  state_key text PRIMARY KEY,
+  max_eid integer
+);
+
+DELETE FROM extraction_state WHERE state_key = 'truth_match';
+INSERT INTO extraction_state SELECT 'truth_match', max(eid) FROM truth_match;
+
 COMMIT;
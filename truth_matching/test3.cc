@@ -15,6 +15,7 @@
 
 #include <pgstring_convert.h>
 #include <PsqlReader.h>
+#include <ParticleClassifier.h>
 
 #include "ParticleGraph.h"
 #include "ParticleGraphWriter.h"
@@ -25,44 +26,9 @@ struct VertexProperties {
   int lund_id;
 };
 
-bool is_terminal_particle(int lund_id) {
-  switch (abs(lund_id)) {
-    case 11:
-    case 13:
-    case 211:
-    case 321:
-    case 22:
-    case 2212:
-    case 2112:
-      return true;
-  }
-  return false;
-}
-
-bool is_undetectable_particle(int lund_id) {
-  switch (abs(lund_id)) {
-    case 12:
-    case 14:
-    case 15:
-    case 16:
-    case 311:
-      return true;
-  }
-  return false;
-}
-
-bool is_acceptable_photon_mother(int lund_id) {
-  switch (abs(lund_id)) {
-    case 111:
-    case 413:
-    case 423:
-      return true;
-  }
-  return false;
-}
-
 template <typename Vertex, typename Graph, typename LundIdPropertyMap>
-void remove_subtrees(Vertex s, Graph &g, LundIdPropertyMap lund_pm) {
+void remove_subtrees(Vertex s, Graph &g, LundIdPropertyMap lund_pm, 
+                     const ParticleClassifier &classifier) {
 
   std::vector<Vertex> to_remove;
   std::unordered_set<Vertex> visited;
@@ -74,7 +40,7 @@ void remove_subtrees(Vertex s, Graph &g, LundIdPropertyMap lund_pm) {
 
     Vertex u = q.front(); q.pop();
 
-    if (is_terminal_particle(get(lund_pm, u))) {
+    if (classifier.is_final_state(get(lund_pm, u))) {
       typename boost::graph_traits<Graph>::out_edge_iterator oe, oe_end, next;
       std::tie(oe, oe_end) = out_edges(u, g);
       for (next = oe; oe != oe_end; oe = next) {
@@ -154,6 +120,9 @@ int main() {
   pgstring_convert(psql.get("to_vertices"), to_vertices);
   pgstring_convert(psql.get("lund_id"), lund_id);
 
+  // particle classification shared with the truth matcher
+  ParticleClassifier classifier("../dat/particle_classes.dat");
+
   // build and analyze graph
   Graph g;
   construct_graph(g, n_vertices, n_edges, from_vertices, to_vertices);
@@ -178,7 +147,7 @@ int main() {
   }
 
   IntPropertyMap lund_pm = get(&VertexProperties::lund_id, g);
-  remove_subtrees(s, g, lund_pm);
+  remove_subtrees(s, g, lund_pm, classifier);
 
   // rip vertices 
   // ------------
@@ -194,7 +163,7 @@ int main() {
 
   std::tie(vi, vi_end) = vertices(g);
   for (; vi != vi_end; ++vi) {
-    if (is_undetectable_particle(get(lund_pm, *vi))) {
+    if (classifier.is_undetectable_particle(get(lund_pm, *vi))) {
       to_rip[get(index_pm, *vi)] = true;
     }
   }
@@ -207,7 +176,7 @@ int main() {
 
       std::tie(ie, ie_end) = in_edges(*vi, g);
       Vertex u = source(*ie, g);
-      if (!is_acceptable_photon_mother(get(lund_pm, u))) {
+      if (!classifier.is_acceptable_photon_mother(get(lund_pm, u))) {
         to_rip[get(index_pm, *vi)] = true;
       }
 
@@ -54,7 +54,7 @@ int main() {
 
   
   // compute truth match
-  TruthMatcher tm;
+  TruthMatcher tm(ParticleClassifier("../dat/particle_classes.dat"));
   tm.set_graph(
       mc_n_vertices, mc_n_edges,
       mc_from_vertices, mc_to_vertices,
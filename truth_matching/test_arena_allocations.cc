@@ -0,0 +1,218 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <set>
+#include <random>
+#include <cstdlib>
+#include <new>
+
+#include "TruthMatcher.h"
+
+// counts the heap allocations that truth matching makes per event, with
+// the event arena of TruthMatcher on and off, and with and without the
+// pruned mc cache. the events are generated here: Y(4S) -> B Bbar with
+// a few common B, D and tau decays, reconstructed from the Y(4S) down
+// with neutrinos dropped and one in ten final states left unmatched.
+//
+//   make test_arena_allocations && ./test_arena_allocations [n_events]
+
+// every operator new of the program, including those of the libraries,
+// goes through here. only calls made while `counting` is set are counted.
+static size_t n_new_calls = 0;
+static bool counting = false;
+
+void* operator new(size_t bytes) {
+  if (counting) { ++n_new_calls; }
+  void *p = std::malloc(bytes ? bytes : 1);
+  if (p == nullptr) { throw std::bad_alloc(); }
+  return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+struct Event {
+  int mc_n_vertices, mc_n_edges;
+  std::vector<int> mc_from_vertices, mc_to_vertices, mc_lund_id;
+  int reco_n_vertices, reco_n_edges;
+  std::vector<int> reco_from_vertices, reco_to_vertices, reco_lund_id;
+  std::vector<std::vector<int>> fs_reco_idx, fs_matched_idx;
+};
+
+class EventGenerator {
+
+  public:
+    EventGenerator(unsigned seed) : rng_(seed) {
+
+      // decay modes of one charge; the other is the charge conjugate
+      modes_[70553] = { { 521, -521 }, { 511, -511 } };
+      modes_[521] = { { -421, 211 }, { -423, -15, 16 }, { -421, -11, 12 } };
+      modes_[511] = { { -411, 211 }, { -413, -15, 16 } };
+      modes_[-423] = { { -421, 111 }, { -421, 22 } };
+      modes_[-413] = { { -421, -211 }, { -411, 111 } };
+      modes_[-421] = { { 321, -211 }, { 321, -211, 111 } };
+      modes_[-411] = { { 321, -211, -211 } };
+      modes_[-15] = { { -11, 12, -16 }, { -211, -16 } };
+      modes_[111] = { { 22, 22 } };
+
+      self_conjugate_ = { 70553, 111, 22 };
+      undetectable_ = { 12, -12, 14, -14, 16, -16 };
+    }
+
+    Event generate() {
+
+      Event e;
+
+      // e- e+ -> Y(4S), decayed recursively
+      e.mc_lund_id = { 11, -11, 70553 };
+      e.mc_from_vertices = { 0 };
+      e.mc_to_vertices = { 2 };
+      decay(2, e);
+      e.mc_n_vertices = e.mc_lund_id.size();
+      e.mc_n_edges = e.mc_from_vertices.size();
+
+      // reconstruct the Y(4S) subtree without the neutrinos. final
+      // states are grouped into hadrons, leptons and photons.
+      std::vector<std::vector<int>> daughters(e.mc_n_vertices);
+      for (int k = 0; k < e.mc_n_edges; ++k) {
+        daughters[e.mc_from_vertices[k]].push_back(e.mc_to_vertices[k]);
+      }
+      e.fs_reco_idx.resize(3);
+      e.fs_matched_idx.resize(3);
+      reconstruct(2, -1, daughters, e);
+      e.reco_n_vertices = e.reco_lund_id.size();
+      e.reco_n_edges = e.reco_from_vertices.size();
+
+      return e;
+    }
+
+  private:
+    int conjugate(int lund_id) const {
+      return self_conjugate_.count(lund_id) ? lund_id : -lund_id;
+    }
+
+    // append the daughters of mc vertex `v`, and theirs
+    void decay(int v, Event &e) {
+
+      int lund_id = e.mc_lund_id[v];
+      bool cc = !modes_.count(lund_id);
+      auto it = modes_.find(cc ? conjugate(lund_id) : lund_id);
+      if (it == modes_.end()) { return; }
+
+      const auto &modes = it->second;
+      std::uniform_int_distribution<size_t> pick(0, modes.size()-1);
+      for (int d : modes[pick(rng_)]) {
+        int u = e.mc_lund_id.size();
+        e.mc_lund_id.push_back(cc ? conjugate(d) : d);
+        e.mc_from_vertices.push_back(v);
+        e.mc_to_vertices.push_back(u);
+        decay(u, e);
+      }
+    }
+
+    // copy mc vertex `v` into the reco graph under reco vertex `mother`
+    void reconstruct(int v, int mother,
+                     const std::vector<std::vector<int>> &daughters,
+                     Event &e) {
+
+      int lund_id = e.mc_lund_id[v];
+      if (undetectable_.count(lund_id)) { return; }
+
+      int u = e.reco_lund_id.size();
+      e.reco_lund_id.push_back(lund_id);
+      if (mother >= 0) {
+        e.reco_from_vertices.push_back(mother);
+        e.reco_to_vertices.push_back(u);
+      }
+
+      if (daughters[v].empty()) {
+        int abs_id = std::abs(lund_id);
+        int group = abs_id == 22 ? 2 : (abs_id == 11 || abs_id == 13 ? 1 : 0);
+        std::uniform_int_distribution<int> lost(0, 9);
+        e.fs_reco_idx[group].push_back(u);
+        e.fs_matched_idx[group].push_back(lost(rng_) == 0 ? -1 : v);
+        return;
+      }
+      for (int d : daughters[v]) { reconstruct(d, u, daughters, e); }
+    }
+
+  private:
+    std::mt19937 rng_;
+    std::map<int, std::vector<std::vector<int>>> modes_;
+    std::set<int> self_conjugate_, undetectable_;
+};
+
+// truth match every event and return the operator new calls per event
+// past the first `n_warmup`, which let the arena and cache settle.
+// the matchings are appended to `matchings`.
+double new_calls_per_event(const std::vector<Event> &events, size_t n_warmup,
+                           size_t cache_size, bool use_arena,
+                           std::vector<std::vector<int>> &matchings) {
+
+  TruthMatcher tm(ParticleClassifier("../dat/particle_classes.dat"));
+  tm.set_pruned_mc_cache_size(cache_size);
+  tm.set_use_arena(use_arena);
+
+  std::vector<int> from_vertices, to_vertices;
+  n_new_calls = 0;
+  for (size_t i = 0; i < events.size(); ++i) {
+    const Event &e = events[i];
+    counting = i >= n_warmup;
+    tm.set_graph(
+        e.mc_n_vertices, e.mc_n_edges,
+        e.mc_from_vertices, e.mc_to_vertices, e.mc_lund_id,
+        e.reco_n_vertices, e.reco_n_edges,
+        e.reco_from_vertices, e.reco_to_vertices, e.reco_lund_id,
+        e.fs_reco_idx, e.fs_matched_idx);
+    tm.get_pruned_mc_edges(from_vertices, to_vertices);
+    const std::vector<int> &matching = tm.get_matching();
+    counting = false;
+    matchings.push_back(matching);
+  }
+
+  return double(n_new_calls) / (events.size() - n_warmup);
+}
+
+int main(int argc, char **argv) {
+
+  size_t n_events = argc > 1 ? std::atoi(argv[1]) : 3000;
+  size_t n_warmup = 100;
+  if (n_events <= n_warmup) {
+    std::cerr << "error: n_events must be more than " << n_warmup << ". ";
+    std::cerr << std::endl;
+    return 1;
+  }
+
+  EventGenerator generator(1);
+  std::vector<Event> events;
+  for (size_t i = 0; i < n_events; ++i) {
+    events.push_back(generator.generate());
+  }
+
+  std::cout << "operator new calls per event over " << n_events - n_warmup;
+  std::cout << " events: " << std::endl;
+  std::cout << std::setw(20) << "pruned mc cache";
+  std::cout << std::setw(12) << "no arena";
+  std::cout << std::setw(12) << "arena" << std::endl;
+
+  for (size_t cache_size : { 0, 1024 }) {
+    std::vector<std::vector<int>> heap_matchings, arena_matchings;
+    double heap = new_calls_per_event(
+        events, n_warmup, cache_size, false, heap_matchings);
+    double arena = new_calls_per_event(
+        events, n_warmup, cache_size, true, arena_matchings);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::setw(20) << cache_size;
+    std::cout << std::setw(12) << heap;
+    std::cout << std::setw(12) << arena << std::endl;
+
+    if (heap_matchings != arena_matchings) {
+      std::cerr << "error: the arena changed the matching. " << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <string>
+#include <stdexcept>
+
+#include <TaskExecutor.h>
+
+// stress test of TaskExecutor. every round runs on a fresh executor:
+// ordered completions, exceptions thrown by tasks and by completions,
+// nested parallel loops and tasks submitted from tasks. build it with
+// ThreadSanitizer to check for data races as well:
+//
+//   make test_task_executor && ./test_task_executor
+//   make test_task_executor_tsan && ./test_task_executor_tsan
+
+const int n_workers = 4;
+const int n_rounds = 50;
+
+void check(bool ok, const std::string &what) {
+  if (!ok) { throw std::logic_error("check failed: " + what + ". "); }
+}
+
+// completions arrive in index order and after their task ran.
+void test_ordered(TaskExecutor &executor, size_t grain) {
+
+  size_t n = 2000, next = 0;
+  std::vector<long> out(n, -1);
+  executor.parallel_for_ordered(n, grain,
+      [&] (int worker, size_t i) {
+        check(worker >= 0 && worker < n_workers, "worker index in range");
+        long s = 0;
+        for (size_t k = 0; k < (i * 7919) % 500; ++k) { s += k; }
+        out[i] = i + s * 0;
+      },
+      [&] (size_t i) {
+        check(i == next, "completions in order");
+        check(out[i] == long(i), "completion after its task");
+        ++next;
+      });
+  check(next == n, "every index completed");
+}
+
+// the first exception of a task or a completion is rethrown, and the
+// executor stays usable.
+void test_exceptions(TaskExecutor &executor) {
+
+  bool caught = false;
+  try {
+    executor.parallel_for(2000, 3, [] (int, size_t i) {
+      if (i == 777) { throw std::runtime_error("task"); }
+    });
+  } catch (std::runtime_error&) { caught = true; }
+  check(caught, "task exception rethrown");
+
+  caught = false;
+  try {
+    executor.parallel_for_ordered(2000, 2, [] (int, size_t) {},
+        [] (size_t i) { if (i == 5) { throw std::logic_error("complete"); } });
+  } catch (std::logic_error&) { caught = true; }
+  check(caught, "completion exception rethrown");
+}
+
+// loops started from within tasks run on the same workers.
+void test_nested(TaskExecutor &executor) {
+
+  std::atomic<long> sum(0);
+  executor.parallel_for(20, 1, [&] (int, size_t) {
+    executor.parallel_for(100, 10, [&] (int, size_t j) { sum += j; });
+  });
+  check(sum == 20 * 4950, "nested loops complete");
+}
+
+// wait() covers the tasks submitted by tasks.
+void test_submit(TaskExecutor &executor) {
+
+  std::atomic<int> count(0);
+  for (int i = 0; i < 1000; ++i) {
+    executor.submit([&] (int) {
+      ++count;
+      if (executor.current_worker() >= 0) {
+        executor.submit([&] (int) { ++count; });
+      }
+    });
+  }
+  executor.wait();
+  check(count == 2000, "submitted tasks complete");
+  check(executor.current_worker() == -1, "caller is not a worker");
+}
+
+int main() {
+
+  try {
+    for (int round = 0; round < n_rounds; ++round) {
+      TaskExecutor executor(n_workers);
+      test_ordered(executor, round % 7 + 1);
+      test_exceptions(executor);
+      test_nested(executor);
+      test_submit(executor);
+    }
+  } catch (std::exception &e) {
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::cout << "passed " << n_rounds << " rounds. " << std::endl;
+  return 0;
+}
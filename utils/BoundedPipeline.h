@@ -0,0 +1,308 @@
+#ifndef _BOUNDED_PIPELINE_H_
+#define _BOUNDED_PIPELINE_H_
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+// class that caps the number of bytes held by the items in flight in a
+// pipeline. acquire() blocks until the bytes fit.
+class MemoryBudget {
+
+  public:
+    MemoryBudget(size_t capacity)
+      : capacity_(capacity), used_(0), peak_(0), reserved_(0), closed_(false) {
+      if (capacity_ == 0) {
+        throw std::invalid_argument(
+            "MemoryBudget::MemoryBudget(): capacity must be positive. ");
+      }
+    }
+
+    // wait until `bytes` fit in the budget and take them. an item larger
+    // than what is left is let through once nothing but the reserve is
+    // held. returns false without taking anything if the budget was closed.
+    bool acquire(size_t bytes) {
+      std::unique_lock<std::mutex> lock(mtx_);
+      cv_.wait(lock, [this, bytes] {
+        return closed_ || used_ == reserved_ || used_ + bytes <= capacity_; });
+      if (closed_) { return false; }
+      take(bytes);
+      return true;
+    }
+
+    // take `bytes` without waiting. used by stages that must not block,
+    // so that the budget cannot deadlock the pipeline.
+    void force_acquire(size_t bytes) {
+      std::lock_guard<std::mutex> lock(mtx_);
+      take(bytes);
+    }
+
+    // hold `bytes` for a buffer that is not an item, in place of what was
+    // reserved before. it takes effect without waiting; the buffer exists
+    // already.
+    void reserve(size_t bytes) {
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (bytes == reserved_) { return; }
+        used_ -= std::min(reserved_, used_);
+        reserved_ = bytes;
+        take(bytes);
+      }
+      cv_.notify_all();
+    }
+
+    void release(size_t bytes) {
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        used_ -= std::min(bytes, used_);
+      }
+      cv_.notify_all();
+    }
+
+    // wake and fail every pending and future acquire().
+    void close() {
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        closed_ = true;
+      }
+      cv_.notify_all();
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    // bytes held now, and the most ever held at once.
+    size_t used() const { std::lock_guard<std::mutex> lock(mtx_); return used_; }
+    size_t peak() const { std::lock_guard<std::mutex> lock(mtx_); return peak_; }
+
+  private:
+    void take(size_t bytes) {
+      used_ += bytes;
+      peak_ = std::max(peak_, used_);
+    }
+
+  private:
+    size_t capacity_;
+    size_t used_, peak_, reserved_;
+    bool closed_;
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+// first in first out queue shared between threads. it has no size limit
+// of its own; a MemoryBudget bounds what producers may put in it.
+template <typename T>
+class ClosableQueue {
+
+  public:
+    ClosableQueue() : closed_(false), cancelled_(false) {}
+
+    void push(T item) {
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        items_.push_back(std::move(item));
+      }
+      cv_.notify_one();
+    }
+
+    // wait for an item. returns false once the queue is closed and
+    // drained, or as soon as it is cancelled.
+    bool pop(T &item) {
+      std::unique_lock<std::mutex> lock(mtx_);
+      cv_.wait(lock, [this] {
+        return cancelled_ || closed_ || !items_.empty(); });
+      if (cancelled_ || items_.empty()) { return false; }
+      item = std::move(items_.front());
+      items_.pop_front();
+      return true;
+    }
+
+    // no more items will be pushed.
+    void close() { set_flag(closed_); }
+
+    // drop the remaining items.
+    void cancel() { set_flag(cancelled_); }
+
+  private:
+    void set_flag(bool &flag) {
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        flag = true;
+      }
+      cv_.notify_all();
+    }
+
+  private:
+    std::deque<T> items_;
+    bool closed_, cancelled_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+// pipeline of a reader, `n_workers` workers and an ordered writer,
+// whose items in flight are held to `memory_budget` bytes.
+//
+// the reader thread calls `read` until it returns false, and hands each
+// item to a worker, which turns it into an output with `work`. the
+// calling thread passes the outputs to `write` in the order they were
+// read.
+//
+// backpressure: an input takes `in_bytes(item)` from the budget before
+// it is queued. the worker swaps these for `out_bytes(output)`, which
+// are returned once the output is written. when workers or the writer
+// fall behind, the budget fills up and the reader waits. only the reader
+// ever waits on the budget, so reordering outputs cannot deadlock; the
+// ceiling may be exceeded by one item per stage.
+//
+// buffers of the reader that are not items, such as the rows a database
+// cursor has fetched but not yet returned, are charged with reserve()
+// from within `read`.
+//
+// usage:
+//
+//    BoundedPipeline<Record, std::string> pipeline(256 << 20, 4);
+//    pipeline.run(
+//        [&] (Record &r) { return read_record(psql, r); },
+//        [&] (int worker, Record &r, std::string &line) { ... },
+//        [&] (std::string &line) { fout << line; },
+//        [] (const Record &r) { return r.bytes(); },
+//        [] (const std::string &line) { return line.capacity(); });
+//
+// the first exception thrown by any stage stops the pipeline and is
+// rethrown by run(). a pipeline runs only once.
+template <typename In, typename Out>
+class BoundedPipeline {
+
+  public:
+    using ReadFunction = std::function<bool(In&)>;
+    using WorkFunction = std::function<void(int, In&, Out&)>;
+    using WriteFunction = std::function<void(Out&)>;
+    using InBytesFunction = std::function<size_t(const In&)>;
+    using OutBytesFunction = std::function<size_t(const Out&)>;
+
+    BoundedPipeline(size_t memory_budget, int n_workers)
+      : budget_(memory_budget), n_workers_(n_workers) {
+      if (n_workers_ <= 0) {
+        throw std::invalid_argument(
+            "BoundedPipeline::BoundedPipeline(): n_workers must be "
+            "positive. ");
+      }
+    }
+
+    // run the pipeline to completion.
+    void run(ReadFunction read, WorkFunction work, WriteFunction write,
+             InBytesFunction in_bytes, OutBytesFunction out_bytes);
+
+    // charge `bytes` held by the reader outside its items, in place of
+    // the previous charge. call from `read`.
+    void reserve(size_t bytes) { budget_.reserve(bytes); }
+
+    // most bytes held at once during the last run
+    size_t peak_bytes() const { return budget_.peak(); }
+
+  private:
+    template <typename T>
+    struct Item {
+      size_t seq_;
+      size_t bytes_;
+      T value_;
+    };
+
+    void fail();
+
+  private:
+    MemoryBudget budget_;
+    int n_workers_;
+
+    ClosableQueue<Item<In>> in_queue_;
+    ClosableQueue<Item<Out>> out_queue_;
+
+    std::mutex error_mtx_;
+    std::exception_ptr error_;
+};
+
+// record the current exception, unless one was recorded already, and
+// stop every stage.
+template <typename In, typename Out>
+void BoundedPipeline<In, Out>::fail() {
+  {
+    std::lock_guard<std::mutex> lock(error_mtx_);
+    if (!error_) { error_ = std::current_exception(); }
+  }
+  budget_.close();
+  in_queue_.cancel();
+  out_queue_.cancel();
+}
+
+template <typename In, typename Out>
+void BoundedPipeline<In, Out>::run(
+    ReadFunction read, WorkFunction work, WriteFunction write,
+    InBytesFunction in_bytes, OutBytesFunction out_bytes) {
+
+  std::thread reader([&] {
+    try {
+      for (size_t seq = 0; ; ++seq) {
+        Item<In> item;
+        if (!read(item.value_)) { break; }
+        item.seq_ = seq;
+        item.bytes_ = in_bytes(item.value_);
+        if (!budget_.acquire(item.bytes_)) { break; }
+        in_queue_.push(std::move(item));
+      }
+      in_queue_.close();
+    } catch (...) { fail(); }
+  });
+
+  std::mutex n_running_mtx;
+  int n_running = n_workers_;
+  std::vector<std::thread> workers;
+  for (int w = 0; w < n_workers_; ++w) {
+    workers.emplace_back([&, w] {
+      try {
+        Item<In> in;
+        while (in_queue_.pop(in)) {
+          Item<Out> out;
+          out.seq_ = in.seq_;
+          work(w, in.value_, out.value_);
+          out.bytes_ = out_bytes(out.value_);
+          budget_.force_acquire(out.bytes_);
+          budget_.release(in.bytes_);
+          out_queue_.push(std::move(out));
+        }
+      } catch (...) { fail(); }
+
+      // the last worker to finish closes the output queue
+      std::lock_guard<std::mutex> lock(n_running_mtx);
+      if (--n_running == 0) { out_queue_.close(); }
+    });
+  }
+
+  // write in read order. outputs that arrive early wait in `pending`.
+  try {
+    std::map<size_t, Item<Out>> pending;
+    size_t next = 0;
+    Item<Out> out;
+    while (out_queue_.pop(out)) {
+      pending.emplace(out.seq_, std::move(out));
+      for (auto it = pending.begin();
+           it != pending.end() && it->first == next;
+           it = pending.erase(it), ++next) {
+        write(it->second.value_);
+        budget_.release(it->second.bytes_);
+      }
+    }
+  } catch (...) { fail(); }
+
+  reader.join();
+  for (auto &t : workers) { t.join(); }
+
+  if (error_) { std::rethrow_exception(error_); }
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include <stdexcept>
+#include <ios>
+
+#include <boost/iostreams/device/file.hpp>
+
+#include "compression.h"
+#include "CompressedOfstream.h"
+
+CompressingStreambuf::CompressingStreambuf(
+    size_t block_size, size_t max_blocks)
+  : block_size_(block_size), max_blocks_(max_blocks), done_(false) {
+
+  if (block_size_ == 0 || max_blocks_ == 0) {
+    throw std::invalid_argument(
+        "CompressingStreambuf: block_size and max_blocks must be positive. ");
+  }
+}
+
+CompressingStreambuf::~CompressingStreambuf() {
+  try { close(); } catch (...) {}
+}
+
+void CompressingStreambuf::open(const std::string &fname) {
+
+  if (is_open()) {
+    throw std::runtime_error(
+        "CompressingStreambuf::open(): another file is already open. ");
+  }
+
+  // assemble the filter chain here so that a bad file name is
+  // reported to the caller rather than in the writer thread.
+  out_.reset(new boost::iostreams::filtering_ostream);
+  push_compressor(*out_, fname);
+  boost::iostreams::file_sink sink(fname, std::ios::out | std::ios::binary);
+  if (!sink.is_open()) {
+    out_.reset();
+    throw std::runtime_error(
+        "CompressingStreambuf::open(): cannot open " + fname + ". ");
+  }
+  out_->push(sink);
+
+  block_.resize(block_size_);
+  setp(block_.data(), block_.data() + block_.size());
+
+  queue_.clear();
+  done_ = false;
+  error_.clear();
+  writer_ = std::thread(&CompressingStreambuf::write_loop, this);
+}
+
+void CompressingStreambuf::close() {
+
+  if (!is_open()) { return; }
+
+  hand_off();
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    done_ = true;
+  }
+  cv_.notify_all();
+  writer_.join();
+
+  setp(nullptr, nullptr);
+  block_.clear();
+
+  if (!error_.empty()) {
+    throw std::runtime_error(
+        "CompressingStreambuf::close(): " + error_ + ". ");
+  }
+}
+
+// hand the filled part of the current block to the writer thread and
+// start a new one. returns false if the writer thread failed.
+bool CompressingStreambuf::hand_off() {
+
+  size_t n = pptr() - pbase();
+
+  std::unique_lock<std::mutex> lock(mtx_);
+  cv_.wait(lock, [this] {
+      return queue_.size() < max_blocks_ || !error_.empty(); });
+  if (!error_.empty()) { return false; }
+
+  if (n > 0) {
+    block_.resize(n);
+    queue_.push_back(std::move(block_));
+    block_ = std::vector<char>(block_size_);
+  }
+  lock.unlock();
+  cv_.notify_all();
+
+  setp(block_.data(), block_.data() + block_.size());
+  return true;
+}
+
+CompressingStreambuf::int_type CompressingStreambuf::overflow(int_type c) {
+
+  if (!is_open() || !hand_off()) { return traits_type::eof(); }
+
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+// blocks are only handed off when full; see the class comment.
+int CompressingStreambuf::sync() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return error_.empty() ? 0 : -1;
+}
+
+void CompressingStreambuf::write_loop() {
+
+  std::vector<char> block;
+  while (true) {
+
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      cv_.wait(lock, [this] { return !queue_.empty() || done_; });
+      if (queue_.empty()) { break; }
+      block = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    cv_.notify_all();
+
+    try {
+      out_->write(block.data(), block.size());
+      if (!*out_) { throw std::runtime_error("write failed"); }
+    } catch (const std::exception &e) {
+      std::lock_guard<std::mutex> lock(mtx_);
+      error_ = e.what();
+      queue_.clear();
+      cv_.notify_all();
+      break;
+    }
+  }
+
+  // flush the compressor and close the file
+  try {
+    out_->reset();
+  } catch (const std::exception &e) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (error_.empty()) { error_ = e.what(); }
+  }
+  out_.reset();
+}
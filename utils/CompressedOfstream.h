@@ -0,0 +1,89 @@
+#ifndef _COMPRESSED_OFSTREAM_H_
+#define _COMPRESSED_OFSTREAM_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <streambuf>
+#include <ostream>
+
+#include <boost/iostreams/filtering_stream.hpp>
+
+// stream buffer that collects output into blocks and hands each full
+// block to a writer thread, which compresses it and writes it to file.
+// the main thread only blocks when `max_blocks` blocks are in flight.
+//
+// flushing does not force data out; blocks are handed off when full and
+// on close(). this keeps `std::endl` cheap.
+class CompressingStreambuf : public std::streambuf {
+
+  public:
+    CompressingStreambuf(size_t block_size = 1 << 20, size_t max_blocks = 4);
+    ~CompressingStreambuf();
+
+    // open `fname` for writing; see compression.h for the suffixes
+    // that select compression. starts the writer thread.
+    void open(const std::string &fname);
+
+    // write out the remaining output, wait for the writer thread and
+    // close the file. throws if any write failed.
+    void close();
+
+    bool is_open() const { return writer_.joinable(); }
+
+  protected:
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+  private:
+    bool hand_off();
+    void write_loop();
+
+  private:
+    size_t block_size_;
+    size_t max_blocks_;
+
+    std::vector<char> block_;
+
+    // blocks waiting for the writer thread. `done_` tells it to exit
+    // once the queue is drained, and `error_` records a failed write.
+    std::deque<std::vector<char>> queue_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool done_;
+    std::string error_;
+
+    // only used by the writer thread while it runs.
+    std::unique_ptr<boost::iostreams::filtering_ostream> out_;
+    std::thread writer_;
+};
+
+// output file stream with transparent compression on a separate thread.
+// use like std::ofstream:
+//
+//   CompressedOfstream fout("mcgraph_adjacency.csv.gz");
+//   fout << "eid,n_vertices" << std::endl;
+//   fout.close();
+//
+// files without a compressed suffix are written uncompressed, still
+// on the writer thread.
+class CompressedOfstream : public std::ostream {
+
+  public:
+    CompressedOfstream() : std::ostream(&buf_) {}
+    explicit CompressedOfstream(const std::string &fname)
+      : CompressedOfstream() { open(fname); }
+
+    void open(const std::string &fname) { buf_.open(fname); clear(); }
+    void close() { buf_.close(); }
+    bool is_open() const { return buf_.is_open(); }
+
+  private:
+    CompressingStreambuf buf_;
+};
+
+#endif
@@ -11,8 +11,13 @@
 #include <cassert>
 
 #include <boost/tokenizer.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/file.hpp>
 
-// class that reads the contents of a csv file. 
+#include "compression.h"
+
+// class that reads the contents of a csv file. compressed files are 
+// decompressed transparently; see compression.h for the suffixes. 
 template <typename TokenizerFunction=boost::escaped_list_separator<char>>
 class CsvReader {
 
@@ -48,7 +53,7 @@ class CsvReader {
   private:
     TokenizerFunction sep_;
 
-    std::ifstream fin_;
+    boost::iostreams::filtering_istream fin_;
     std::string line_;
 
     std::unordered_map<std::string, size_t> colname_idx_;
@@ -2,7 +2,7 @@ template <typename TokenizerFunction>
 void CsvReader<TokenizerFunction>::open(const std::string &fname) {
 
   // check if another file is already open.
-  if (fin_.is_open()) {
+  if (!fin_.empty()) {
     throw std::runtime_error(
         "CsvReader<>::open() : another file is already open. " 
         "run close() before running another open(). "
@@ -12,12 +12,14 @@ void CsvReader<TokenizerFunction>::open(const std::string &fname) {
   assert(cache_.empty());
 
   // open the file and read the title line
-  fin_.open(fname);
-  if (!fin_.is_open()) {
+  boost::iostreams::file_source source(fname, std::ios::in | std::ios::binary);
+  if (!source.is_open()) {
     throw std::runtime_error(
       "CsvReader<>::open() : file " + fname + " does not exist. " 
     );
   }
+  push_decompressor(fin_, fname);
+  fin_.push(source);
   std::getline(fin_, line_);
 
   // assign column name indices and caches
@@ -31,7 +33,7 @@ void CsvReader<TokenizerFunction>::open(const std::string &fname) {
 
 template <typename TokenizerFunction>
 void CsvReader<TokenizerFunction>::close() {
-  fin_.close(); 
+  fin_.reset(); 
   colname_idx_.clear(); 
   cache_.clear(); 
 }
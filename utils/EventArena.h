@@ -0,0 +1,151 @@
+#ifndef _EVENT_ARENA_H_
+#define _EVENT_ARENA_H_
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+// class that hands out memory for the temporaries of one event and takes
+// it all back at once with reset().
+//
+// allocation bumps a pointer into a block; deallocation is a no-op
+// except for the most recent allocation, which is rolled back so that
+// growing vectors reuse their space. when an event overflows the current
+// block, another is allocated, and the next reset() merges them into a
+// single block big enough for the whole event. after the first few
+// events, no event allocates from the heap at all.
+//
+// usage:
+//
+//    EventArena arena;
+//    for (...each event...) {
+//      arena.reset();
+//      ArenaVector<int> q(ArenaAllocator<int>(arena));
+//      ...
+//    }
+//
+// memory handed out before reset() must not be used after it.
+class EventArena {
+
+  public:
+    EventArena(size_t block_size = 64 << 10)
+      : block_size_(block_size), top_(nullptr), end_(nullptr),
+        used_(0), n_heap_allocations_(0), bypass_(false) {}
+
+    // nothing handed out outlives an event, so copies start empty. this
+    // keeps the classes that own an arena copyable.
+    EventArena(const EventArena &other) : EventArena(other.block_size_) {
+      bypass_ = other.bypass_;
+    }
+    EventArena& operator=(const EventArena&) { return *this; }
+
+    void* allocate(size_t bytes, size_t alignment) {
+      if (bypass_) { used_ += bytes; return ::operator new(bytes); }
+      char *p = align(top_, alignment);
+      if (p == nullptr || p + bytes > end_) {
+        add_block(bytes + alignment);
+        p = align(top_, alignment);
+      }
+      top_ = p + bytes;
+      used_ += bytes;
+      return p;
+    }
+
+    void deallocate(void *p, size_t bytes) {
+      if (bypass_) { ::operator delete(p); return; }
+      if (static_cast<char*>(p) + bytes == top_) { top_ = static_cast<char*>(p); }
+    }
+
+    // take back everything handed out. O(1) unless the last event spilled
+    // into more than one block.
+    void reset() {
+      if (blocks_.size() > 1) {
+        size_t size = 0;
+        for (const auto &b : blocks_) { size += b.second; }
+        blocks_.clear();
+        add_block(size);
+      }
+      if (!blocks_.empty()) {
+        top_ = blocks_.back().first.get();
+        end_ = top_ + blocks_.back().second;
+      }
+      used_ = 0;
+    }
+
+    // hand out memory straight from the heap instead, one allocation per
+    // request, as std::allocator does. for measuring what the arena
+    // saves. change it only while nothing handed out is in use.
+    void set_bypass(bool bypass) { bypass_ = bypass; }
+    bool bypass() const { return bypass_; }
+
+    // bytes handed out since the last reset, and the number of blocks
+    // ever allocated from the heap.
+    size_t used() const { return used_; }
+    size_t n_heap_allocations() const { return n_heap_allocations_; }
+
+  private:
+    static char* align(char *p, size_t alignment) {
+      if (p == nullptr) { return nullptr; }
+      uintptr_t u = reinterpret_cast<uintptr_t>(p);
+      return p + (alignment - u % alignment) % alignment;
+    }
+
+    void add_block(size_t min_size) {
+      size_t size = std::max(block_size_, min_size);
+      blocks_.emplace_back(std::unique_ptr<char[]>(new char[size]), size);
+      ++n_heap_allocations_;
+      top_ = blocks_.back().first.get();
+      end_ = top_ + size;
+    }
+
+  private:
+    size_t block_size_;
+    std::vector<std::pair<std::unique_ptr<char[]>, size_t>> blocks_;
+    char *top_, *end_;
+    size_t used_;
+    size_t n_heap_allocations_;
+    bool bypass_;
+};
+
+// standard allocator drawing from an EventArena. containers using it
+// must not outlive the next reset() of the arena.
+template <typename T>
+class ArenaAllocator {
+
+  public:
+    using value_type = T;
+
+    ArenaAllocator(EventArena &arena) : arena_(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena()) {}
+
+    T* allocate(size_t n) {
+      return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, size_t n) { arena_->deallocate(p, n * sizeof(T)); }
+
+    EventArena* arena() const { return arena_; }
+
+  private:
+    EventArena *arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return !(a == b);
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif
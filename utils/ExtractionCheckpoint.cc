@@ -0,0 +1,85 @@
+#include <fstream>
+#include <stdexcept>
+#include <cstdio>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ExtractionCheckpoint.h"
+
+ExtractionCheckpoint::ExtractionCheckpoint(const std::string &fname) 
+  : fname_(fname), last_eid_(0), offset_(0), n_records_(0) {}
+
+bool ExtractionCheckpoint::load() {
+
+  std::ifstream fin(fname_);
+  if (!fin.is_open()) { return false; }
+
+  if (!(fin >> last_eid_ >> offset_ >> n_records_)) {
+    throw std::runtime_error(
+        "ExtractionCheckpoint::load(): malformed checkpoint file " 
+        + fname_ + ". ");
+  }
+
+  return true;
+}
+
+void ExtractionCheckpoint::save(
+    int last_eid, std::ostream &os, size_t n_records) {
+
+  // the output must reach the file before its offset is recorded
+  os.flush();
+  std::streamoff offset = os.tellp();
+  if (!os || offset < 0) {
+    throw std::runtime_error(
+        "ExtractionCheckpoint::save(): cannot determine output offset. ");
+  }
+
+  // write to a temporary file and rename it over the checkpoint. 
+  // rename is atomic, so a crash never leaves a partial checkpoint. 
+  std::string tmp_fname = fname_ + ".tmp";
+  std::ofstream fout(tmp_fname);
+  fout << last_eid << " " << offset << " " << n_records << std::endl;
+  fout.close();
+  if (!fout) {
+    throw std::runtime_error(
+        "ExtractionCheckpoint::save(): cannot write " + tmp_fname + ". ");
+  }
+
+  if (std::rename(tmp_fname.c_str(), fname_.c_str()) != 0) {
+    throw std::runtime_error(
+        "ExtractionCheckpoint::save(): cannot rename " 
+        + tmp_fname + " to " + fname_ + ". ");
+  }
+
+  last_eid_ = last_eid;
+  offset_ = offset;
+  n_records_ = n_records;
+}
+
+void ExtractionCheckpoint::truncate(const std::string &output_fname) const {
+
+  // truncating past the end would pad the output with nul bytes. the 
+  // checkpoint then belongs to some other file. 
+  struct stat st;
+  if (::stat(output_fname.c_str(), &st) != 0) {
+    throw std::runtime_error(
+        "ExtractionCheckpoint::truncate(): cannot stat " 
+        + output_fname + ". ");
+  }
+  if (offset_ > st.st_size) {
+    throw std::runtime_error(
+        "ExtractionCheckpoint::truncate(): checkpoint offset is past the "
+        "end of " + output_fname + ". ");
+  }
+
+  if (::truncate(output_fname.c_str(), offset_) != 0) {
+    throw std::runtime_error(
+        "ExtractionCheckpoint::truncate(): cannot truncate " 
+        + output_fname + ". ");
+  }
+}
+
+void ExtractionCheckpoint::remove() {
+  std::remove(fname_.c_str());
+}
@@ -0,0 +1,70 @@
+#ifndef _EXTRACTION_CHECKPOINT_H_
+#define _EXTRACTION_CHECKPOINT_H_
+
+#include <string>
+#include <iostream>
+
+// class that records the progress of an extraction job so that an 
+// interrupted job can be resumed instead of restarted. 
+//
+// a checkpoint consists of 
+// + last_eid: eid of the last record completely written to the output. 
+// + offset: size of the output file after that record was written. 
+// + n_records: number of records processed so far. 
+//
+// checkpoints are written to a temporary file that is then renamed over 
+// `fname`, so the file on disk always holds a complete checkpoint. 
+//
+// usage: 
+//
+// 1. construct with the checkpoint file name:
+//
+//    ExtractionCheckpoint ckpt("output.csv.ckpt");
+//
+// 2. when resuming, load the previous state, truncate the output to the 
+//    recorded offset, and continue reading records with eid > last_eid():
+//
+//    if (ckpt.load()) { 
+//      ckpt.truncate("output.csv"); 
+//      // open output in append mode, read records after ckpt.last_eid()
+//    }
+//
+// 3. periodically save the state after flushing the output stream:
+//
+//    ckpt.save(eid, fout, n_records);
+//
+// 4. remove the checkpoint once the job completes:
+//
+//    ckpt.remove();
+//
+class ExtractionCheckpoint {
+
+  public:
+    ExtractionCheckpoint(const std::string &fname);
+
+    // load the checkpoint from file. returns false if none exists. 
+    bool load();
+
+    // flush `os` and atomically record it as the state after `last_eid`. 
+    void save(int last_eid, std::ostream &os, size_t n_records);
+
+    // truncate `output_fname` to the recorded output offset. throws if 
+    // the file is shorter than that. 
+    void truncate(const std::string &output_fname) const;
+
+    // remove the checkpoint file. 
+    void remove();
+
+    int last_eid() const { return last_eid_; }
+    std::streamoff offset() const { return offset_; }
+    size_t n_records() const { return n_records_; }
+
+  private:
+    std::string fname_;
+
+    int last_eid_;
+    std::streamoff offset_;
+    size_t n_records_;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef _LRU_CACHE_H_
+#define _LRU_CACHE_H_
+
+#include <list>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+
+// class that maps keys to values and holds at most `capacity` entries. 
+// inserting into a full cache evicts the least recently used entry. 
+// a capacity of 0 disables the cache; nothing is ever stored. 
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+
+  private:
+    using Entry = std::pair<Key, Value>;
+    using EntryIter = typename std::list<Entry>::iterator;
+
+  public:
+    LruCache(size_t capacity=0) : capacity_(capacity) {}
+
+    size_t capacity() const { return capacity_; }
+    size_t size() const { return index_.size(); }
+
+    // change the capacity, evicting entries as necessary. 
+    void set_capacity(size_t capacity) { 
+      capacity_ = capacity; 
+      while (index_.size() > capacity_) { evict(); }
+    }
+
+    // get the value stored under `key` and mark it most recently used. 
+    // returns nullptr if there is none. 
+    Value* find(const Key &key) {
+      auto it = index_.find(key);
+      if (it == index_.end()) { return nullptr; }
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return &it->second->second;
+    }
+
+    // store `value` under `key`, replacing any value already there, 
+    // and mark it most recently used. 
+    void insert(const Key &key, Value value) {
+      if (capacity_ == 0) { return; }
+
+      auto it = index_.find(key);
+      if (it != index_.end()) {
+        it->second->second = std::move(value);
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return;
+      }
+
+      if (index_.size() >= capacity_) { evict(); }
+      entries_.emplace_front(key, std::move(value));
+      index_[key] = entries_.begin();
+    }
+
+    void clear() { index_.clear(); entries_.clear(); }
+
+  private:
+    void evict() {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+
+  private:
+    size_t capacity_;
+    std::list<Entry> entries_;
+    std::unordered_map<Key, EntryIter, Hash> index_;
+};
+
+#endif
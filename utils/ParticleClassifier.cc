@@ -0,0 +1,62 @@
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "ParticleClassifier.h"
+
+// largest absolute lund id accepted. bounds the size of the table. 
+static const int max_abs_lund_id = 1 << 24;
+
+ParticleClassifier::ParticleClassifier(const std::string &fname) 
+  : table_(1, 0) {
+
+  std::ifstream fin(fname);
+  if (!fin.is_open()) {
+    throw std::runtime_error(
+        "ParticleClassifier::ParticleClassifier(): cannot open " 
+        + fname + ". ");
+  }
+
+  std::string line;
+  while (std::getline(fin, line)) {
+
+    std::istringstream iss(line);
+    std::string class_name; int lund_id;
+    if (!(iss >> class_name) || class_name[0] == '#') { continue; }
+
+    if (!(iss >> lund_id)) {
+      throw std::runtime_error(
+          "ParticleClassifier::ParticleClassifier(): malformed line in " 
+          + fname + ": " + line + ". ");
+    }
+
+    add(class_name, lund_id);
+  }
+}
+
+void ParticleClassifier::add(const std::string &class_name, int lund_id) {
+
+  uint8_t flag;
+  if (class_name == "final_state") { 
+    flag = FINAL_STATE; 
+  } else if (class_name == "undetectable") { 
+    flag = UNDETECTABLE; 
+  } else if (class_name == "photon_mother") { 
+    flag = PHOTON_MOTHER; 
+  } else {
+    throw std::invalid_argument(
+        "ParticleClassifier::add(): unknown particle class " 
+        + class_name + ". ");
+  }
+
+  int i = std::abs(lund_id);
+  if (i >= max_abs_lund_id) {
+    throw std::invalid_argument(
+        "ParticleClassifier::add(): lund id " 
+        + std::to_string(lund_id) + " is out of range. ");
+  }
+
+  // keep one trailing entry of 0 for ids past the end of the table
+  if (static_cast<size_t>(i) + 1 >= table_.size()) { table_.resize(i+2, 0); }
+  table_[i] |= flag;
+}
@@ -0,0 +1,71 @@
+#ifndef _PARTICLE_CLASSIFIER_H_
+#define _PARTICLE_CLASSIFIER_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+// class that classifies particles by lund id for the purpose of 
+// truth matching. 
+//
+// the classes are read from a classification file, usually 
+// `dat/particle_classes.dat`, where each line names a class and a lund id. 
+// there is no built in classification, so the matching rules change 
+// with the file alone: 
+//
+//   final_state 211
+//   undetectable 12
+//   photon_mother 111
+//
+// lines that are blank or begin with '#' are ignored. the sign of the 
+// lund id is ignored, so a line covers both the particle and its 
+// anti-particle. the recognized classes are 
+// + final_state: particles whose decay products are not matched. 
+// + undetectable: particles removed from the graph being matched. 
+// + photon_mother: particles whose daughter photons are matched. 
+//
+// the classes of each lund id are packed as bit flags into a table 
+// indexed by the absolute lund id, so a lookup is a single array read. 
+class ParticleClassifier {
+
+  public:
+    enum Flag : uint8_t {
+      FINAL_STATE = 1 << 0,
+      UNDETECTABLE = 1 << 1,
+      PHOTON_MOTHER = 1 << 2
+    };
+
+  public:
+
+    // construct the classification using a classification file. 
+    ParticleClassifier(const std::string &fname);
+
+    bool is_final_state(int lund_id) const { 
+      return test(lund_id, FINAL_STATE); 
+    }
+
+    bool is_undetectable_particle(int lund_id) const { 
+      return test(lund_id, UNDETECTABLE); 
+    }
+
+    bool is_acceptable_photon_mother(int lund_id) const { 
+      return test(lund_id, PHOTON_MOTHER); 
+    }
+
+  private:
+    void add(const std::string &class_name, int lund_id);
+
+    // the last entry of `table_` is always 0. lund ids past the end 
+    // of the table are clamped to it rather than branched on. 
+    bool test(int lund_id, uint8_t flag) const {
+      size_t i = std::min<size_t>(std::abs(lund_id), table_.size()-1);
+      return table_[i] & flag;
+    }
+
+  private:
+    std::vector<uint8_t> table_;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <unordered_set>
+#include <map>
+#include <mutex>
+
+#include "ParticleTable.h"
+
+namespace {
+
+// 64 bit fnv-1a hash of a name.
+uint64_t name_hash(const char *s, size_t n) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < n; ++i) {
+    h ^= static_cast<unsigned char>(s[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// splitmix64 finalizer. decorrelates the slot from the bucket, which
+// both derive from the same name hash.
+uint64_t mix(uint64_t h) {
+  h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+size_t slot_of(uint64_t h, uint32_t displacement, size_t n_slots) {
+  return mix(h + (displacement + 1) * 0x9e3779b97f4a7c15ULL) % n_slots;
+}
+
+}
+
+ParticleTable::ParticleTable(const std::string &fname) {
+
+  std::ifstream fin(fname);
+  if (!fin.is_open()) {
+    throw std::runtime_error(
+        "ParticleTable::ParticleTable(): cannot open " + fname + ". ");
+  }
+
+  // read the entries in file order, skipping repeated names and ids
+  std::vector<std::pair<int, std::string>> entries;
+  std::unordered_set<std::string> seen_names;
+  std::unordered_set<int> seen_ids;
+  std::string name; int id;
+  while (fin >> name >> id) {
+    if (seen_names.count(name) || seen_ids.count(id)) { continue; }
+    seen_names.insert(name);
+    seen_ids.insert(id);
+    entries.emplace_back(id, name);
+  }
+  std::sort(entries.begin(), entries.end());
+
+  // flatten
+  ids_.reserve(entries.size());
+  name_offsets_.reserve(entries.size()+1);
+  name_offsets_.push_back(0);
+  for (const auto &e : entries) {
+    ids_.push_back(e.first);
+    names_ += e.second;
+    name_offsets_.push_back(names_.size());
+  }
+
+  build_name_hash();
+}
+
+// assign every name a distinct slot. buckets are placed largest first,
+// each with the smallest displacement that sends all of its names to
+// free slots.
+void ParticleTable::build_name_hash() {
+
+  size_t n = ids_.size();
+  size_t n_buckets = n/2 + 1;
+
+  displacements_.assign(n_buckets, 0);
+  slots_.assign(n, 0);
+  if (n == 0) { return; }
+
+  std::vector<uint64_t> hashes(n);
+  std::vector<std::vector<uint32_t>> buckets(n_buckets);
+  for (size_t i = 0; i < n; ++i) {
+    hashes[i] = name_hash(names_.data() + name_offsets_[i],
+                          name_offsets_[i+1] - name_offsets_[i]);
+    buckets[hashes[i] % n_buckets].push_back(i);
+  }
+
+  std::vector<uint32_t> order(n_buckets);
+  for (size_t b = 0; b < n_buckets; ++b) { order[b] = b; }
+  std::stable_sort(order.begin(), order.end(),
+      [&buckets] (uint32_t a, uint32_t b) {
+        return buckets[a].size() > buckets[b].size(); });
+
+  std::vector<bool> taken(n, false);
+  std::vector<size_t> candidate;
+  for (uint32_t b : order) {
+
+    if (buckets[b].empty()) { break; }
+
+    uint32_t d = 0;
+    for (; d < (1u << 24); ++d) {
+      candidate.clear();
+      bool ok = true;
+      for (uint32_t i : buckets[b]) {
+        size_t s = slot_of(hashes[i], d, n);
+        if (taken[s] ||
+            std::find(candidate.begin(), candidate.end(), s) != candidate.end()) {
+          ok = false; break;
+        }
+        candidate.push_back(s);
+      }
+      if (ok) { break; }
+    }
+
+    if (d == (1u << 24)) {
+      throw std::runtime_error(
+          "ParticleTable::build_name_hash(): cannot place the names. ");
+    }
+
+    displacements_[b] = d;
+    for (size_t k = 0; k < buckets[b].size(); ++k) {
+      taken[candidate[k]] = true;
+      slots_[candidate[k]] = buckets[b][k];
+    }
+  }
+}
+
+std::shared_ptr<const ParticleTable>
+ParticleTable::load(const std::string &fname) {
+
+  static std::mutex mtx;
+  static std::map<std::string, std::shared_ptr<const ParticleTable>> tables;
+
+  std::lock_guard<std::mutex> lock(mtx);
+  auto &table = tables[fname];
+  if (!table) { table = std::make_shared<const ParticleTable>(fname); }
+  return table;
+}
+
+size_t ParticleTable::name_slot(const std::string &name) const {
+  uint64_t h = name_hash(name.data(), name.size());
+  return slot_of(h, displacements_[h % displacements_.size()], slots_.size());
+}
+
+bool ParticleTable::name_equals(size_t i, const std::string &name) const {
+  return names_.compare(name_offsets_[i],
+                        name_offsets_[i+1] - name_offsets_[i], name) == 0;
+}
+
+int ParticleTable::get(const std::string &name) const {
+  if (!ids_.empty()) {
+    size_t i = slots_[name_slot(name)];
+    if (name_equals(i, name)) { return ids_[i]; }
+  }
+  throw std::out_of_range(
+      "ParticleTable::get(): unknown particle name " + name + ". ");
+}
+
+std::string ParticleTable::get(int id) const {
+  auto it = std::lower_bound(ids_.begin(), ids_.end(), id);
+  if (it == ids_.end() || *it != id) {
+    throw std::out_of_range(
+        "ParticleTable::get(): unknown lund id " + std::to_string(id) + ". ");
+  }
+  size_t i = it - ids_.begin();
+  return names_.substr(name_offsets_[i], name_offsets_[i+1] - name_offsets_[i]);
+}
@@ -1,44 +1,62 @@
 #ifndef _PARTICLE_TABLE_H_
 #define _PARTICLE_TABLE_H_
 
-#include <iostream>
-#include <fstream>
 #include <string>
-#include <boost/bimap.hpp>
-
-// class that maps particle lund id <=> particle name
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// class that maps particle lund id <=> particle name.
+//
+// the table is immutable once constructed and is meant to be shared:
+// use ParticleTable::load() to read each particle data file only once
+// and hand the same instance to every writer and thread.
+//
+// entries are stored flat, sorted by lund id, with the names packed
+// into a single string. lund id lookups are a binary search and name
+// lookups a perfect hash, so neither allocates nor chases pointers.
 class ParticleTable {
 
-  private:
-    using bm_type = boost::bimap<std::string, int>;
-    using left_type = bm_type::left_map;
-    using right_type = bm_type::right_map;
-
   public:
 
-    // construct the table using the particle data file. 
-    // this is usually named `pdt.dat`. 
-    ParticleTable(const std::string &fname) 
-      : table_(), name2id_(table_.left), id2name_(table_.right) {
+    // construct the table using the particle data file.
+    // this is usually named `pdt.dat`. each line holds a particle name
+    // and its lund id. if a name or lund id repeats, the first line wins.
+    ParticleTable(const std::string &fname);
 
-      std::ifstream fin(fname);
-      std::string name; int id;
-      while (fin >> name >> id) {
-        table_.insert(bm_type::value_type(name, id));
-      }
-    }
+    // shared table for the particle data file `fname`. the file is read
+    // on the first call for each name only. thread safe.
+    static std::shared_ptr<const ParticleTable> load(const std::string &fname);
 
-    // get particle lund id from its name.
-    int get(const std::string &name) const { return name2id_.at(name); }
+    // get particle lund id from its name. throws std::out_of_range
+    // if the name is unknown.
+    int get(const std::string &name) const;
 
-    // get particle name id from its lundid.
-    std::string get(int id) const { return id2name_.at(id); }
+    // get particle name from its lund id. throws std::out_of_range
+    // if the lund id is unknown.
+    std::string get(int id) const;
+
+    // number of particles in the table.
+    size_t size() const { return ids_.size(); }
+
+  private:
+    void build_name_hash();
+    size_t name_slot(const std::string &name) const;
+    bool name_equals(size_t i, const std::string &name) const;
 
   private:
-    bm_type table_;
-    left_type &name2id_;
-    right_type &id2name_;
 
+    // entries sorted by lund id. the name of entry `i` is
+    // names_[name_offsets_[i], name_offsets_[i+1]).
+    std::vector<int> ids_;
+    std::vector<uint32_t> name_offsets_;
+    std::string names_;
+
+    // hash and displace perfect hash of the names. a name hashes to a
+    // bucket, whose displacement picks its slot; `slots_` holds the
+    // entry index for each slot.
+    std::vector<uint32_t> displacements_;
+    std::vector<uint32_t> slots_;
 };
 
 #endif
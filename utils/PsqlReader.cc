@@ -1,29 +1,105 @@
 #include <stdexcept>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 
 #include "PsqlReader.h"
 
+namespace {
+
+// use this to reset PGconn* objects
+void reset_pgconn(PGconn **conn) {
+  if (*conn) { PQfinish(*conn); }
+  *conn = nullptr;
+}
+
+// use this to reset PGresult* objects
+void reset_pgresult(PGresult **res) {
+  if (*res) { PQclear(*res); }
+  *res = nullptr;
+}
+
+}
+
+// PsqlReader
+// ----------
+
 PsqlReader::PsqlReader() 
-  : conn_(nullptr), res_(nullptr), qres_(nullptr) {};
+  : conn_(nullptr), max_retries_(0), 
+    target_bytes_(0), target_seconds_(0), max_bytes_(0), 
+    current_(nullptr) {};
 
 PsqlReader::~PsqlReader() {
+  cursors_.clear();
   reset_pgconn(&conn_);
-  reset_pgresult(&res_);
-  reset_pgresult(&qres_);
 }
 
 void PsqlReader::open_connection(const std::string &conninfo) {
-  conn_ = PQconnectdb(conninfo.c_str());
+  conninfo_ = conninfo;
+  connect();
+}
+
+void PsqlReader::close_connection() { 
+  cursors_.clear();
+  current_ = nullptr;
+  reset_pgconn(&conn_); 
+}
+
+void PsqlReader::connect() {
+  conn_ = PQconnectdb(conninfo_.c_str());
   if (PQstatus(conn_) != CONNECTION_OK) {
     throw std::runtime_error(
       std::string("Connection to database failed: ") + PQerrorMessage(conn_));
   }
 }
 
+// execute a command that returns no rows. throws on failure.
+void PsqlReader::exec_command(const std::string &command) {
+  PGresult *res = PQexec(conn_, command.c_str());
+  if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+    std::string msg = PQerrorMessage(conn_);
+    reset_pgresult(&res);
+    throw std::runtime_error(command + " command failed: " + msg);
+  }
+  reset_pgresult(&res);
+}
+
+void PsqlReader::enable_reconnect(
+    const std::string &key_column, int max_retries) {
+  key_column_ = key_column;
+  max_retries_ = max_retries;
+}
+
+void PsqlReader::enable_adaptive_fetch(
+    size_t target_bytes, double target_seconds, size_t max_bytes) {
+  if (target_bytes == 0 || target_seconds <= 0 || max_bytes < target_bytes) {
+    throw std::invalid_argument(
+        "PsqlReader::enable_adaptive_fetch(): targets must be positive "
+        "and max_bytes at least target_bytes. ");
+  }
+  target_bytes_ = target_bytes;
+  target_seconds_ = target_seconds;
+  max_bytes_ = max_bytes;
+}
+
 void PsqlReader::open_cursor(
     const std::string &table_name, 
     const std::vector<std::string> &colnames,
     size_t max_rows, 
     const std::string &cursor_name) {
+  open_cursor(table_name, colnames, "", {}, "", -1, max_rows, cursor_name);
+}
+
+void PsqlReader::open_cursor(
+    const std::string &table_name, 
+    const std::vector<std::string> &colnames,
+    const std::string &where_clause, 
+    const std::vector<std::string> &params,
+    const std::string &order_by,
+    long limit,
+    size_t max_rows, 
+    const std::string &cursor_name) {
 
   if (colnames.size() == 0) { 
     throw std::invalid_argument(
@@ -35,31 +111,118 @@ void PsqlReader::open_cursor(
         "PsqlReader::open_cursor(): you must load at least 1 row. ");
   }
 
-  cursor_name_ = cursor_name;
+  if (cursors_.find(cursor_name) != cursors_.end()) {
+    throw std::invalid_argument(
+        "PsqlReader::open_cursor(): cursor " + cursor_name
+        + " is already open. ");
+  }
 
-  // open a transaction. required for cursors. 
-  res_ = PQexec(conn_, "BEGIN");
-  if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
-    throw std::runtime_error(
-        std::string("BEGIN command failed: ") + PQerrorMessage(conn_));
+  std::unique_ptr<PsqlCursor> c(new PsqlCursor(
+        *this, cursor_name, table_name, colnames,
+        where_clause, params, order_by, limit, max_rows));
+
+  // open a transaction. required for cursors. all cursors share it.
+  if (cursors_.empty()) { exec_command("BEGIN"); }
+
+  try {
+    c->declare(key_column_);
+  } catch (...) {
+    if (cursors_.empty()) { PQclear(PQexec(conn_, "ROLLBACK")); }
+    throw;
   }
-  reset_pgresult(&res_);
 
+  current_ = c.get();
+  cursors_[cursor_name] = std::move(c);
 
-  // assemble query statement
-  std::string query_stmt;
-  for (const auto &col : colnames) { query_stmt += col + ","; }
-  query_stmt.pop_back();
-  query_stmt = "SELECT " + query_stmt + " FROM " + table_name;
+}
 
-  // declare cursor
-  res_ = PQexec(conn_,
-     ("DECLARE " + cursor_name_ + " CURSOR FOR " + query_stmt).c_str());
-  if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
-    throw std::runtime_error(
-        std::string("DECLARE CURSOR failed: ") + PQerrorMessage(conn_));
+PsqlCursor& PsqlReader::cursor(const std::string &cursor_name) {
+  auto it = cursors_.find(cursor_name);
+  if (it == cursors_.end()) {
+    throw std::invalid_argument(
+        "PsqlReader::cursor(): cursor " + cursor_name + " is not open. ");
+  }
+  return *it->second;
+}
+
+void PsqlReader::close_cursor() {
+  if (current_ == nullptr) {
+    throw std::logic_error(
+        "PsqlReader::close_cursor(): no cursor is open. ");
+  }
+  close_cursor(current_->name());
+}
+
+void PsqlReader::close_cursor(const std::string &cursor_name) {
+
+  PsqlCursor &c = cursor(cursor_name);
+
+  // clear query result set
+  reset_pgresult(&c.qres_);
+
+  // close cursor
+  exec_command("CLOSE " + cursor_name);
+
+  bool was_current = (current_ == &c);
+  cursors_.erase(cursor_name);
+
+  // some remaining cursor becomes current. close the
+  // transaction once no cursors remain.
+  if (was_current) {
+    current_ = cursors_.empty() ? nullptr : cursors_.rbegin()->second.get();
+  }
+  if (cursors_.empty()) { exec_command("END"); }
+
+}
+
+// called when a fetch failed. throws if recovery is disabled or
+// exhausted. otherwise, opens a fresh connection and redeclares every
+// open cursor so that it continues after the rows it already fetched.
+void PsqlReader::recover(int n_retries, const std::string &msg) {
+
+  if (key_column_.empty() || n_retries >= max_retries_) {
+    throw std::runtime_error("FETCH failed: " + msg);
   }
-  reset_pgresult(&res_);
+
+  std::cerr << "PsqlReader: FETCH failed: " << msg;
+  std::cerr << "reconnecting (attempt " << n_retries+1 << "). ";
+  std::cerr << std::endl;
+
+  // back off before reconnecting; the server may be restarting. the 
+  // wait doubles per attempt up to a minute. 
+  std::this_thread::sleep_for(std::chrono::seconds(
+        n_retries < 6 ? 1 << n_retries : 60));
+
+  try {
+    reset_pgconn(&conn_);
+    connect();
+    exec_command("BEGIN");
+    for (auto &p : cursors_) { p.second->redeclare(); }
+  } catch (const std::runtime_error &e) {
+    std::cerr << e.what() << std::endl;
+  }
+}
+
+
+// PsqlCursor
+// ----------
+
+PsqlCursor::PsqlCursor(
+    PsqlReader &reader,
+    const std::string &cursor_name,
+    const std::string &table_name, 
+    const std::vector<std::string> &colnames,
+    const std::string &where_clause, 
+    const std::vector<std::string> &params,
+    const std::string &order_by,
+    long limit, size_t max_rows)
+  : reader_(reader), qres_(nullptr),
+    cursor_name_(cursor_name),
+    table_name_(table_name), colnames_(colnames),
+    where_clause_(where_clause), params_(params),
+    order_by_(order_by), limit_(limit),
+    n_fetched_(0), fetch_rows_(max_rows), last_fetch_rows_(max_rows), 
+    bytes_per_row_(0), seconds_per_row_(0), fetch_bytes_(0) {
 
   // initialize the column map and caches
   for (size_t i = 0; i < colnames.size(); ++i) {
@@ -71,33 +234,75 @@ void PsqlReader::open_cursor(
   max_rows_ = max_rows;
   curr_max_ = max_rows_;
   curr_idx_ = curr_max_;
-
 }
 
-void PsqlReader::close_cursor() {
-
-  // clear query result set
+PsqlCursor::~PsqlCursor() {
   reset_pgresult(&qres_);
+}
 
-  // close cursor
-  res_ = PQexec(conn_, ("CLOSE " + cursor_name_).c_str());
-  if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
-    throw std::runtime_error(
-        std::string("CLOSE cursor failed: ") + PQerrorMessage(conn_));
+// declare the cursor on the reader's connection. if `key_column` is
+// non-empty, the rows are ordered by it so the cursor can be redeclared
+// after a reconnect.
+void PsqlCursor::declare(const std::string &key_column) {
+
+  // resuming after a reconnect requires rows ordered by a selected key
+  key_column_ = key_column;
+  if (!key_column_.empty()) {
+    if (name2idx_.find(key_column_) == name2idx_.end()) {
+      throw std::invalid_argument(
+          "PsqlReader::open_cursor(): reconnect key column "
+          + key_column_ + " must be selected. ");
+    }
+    if (order_by_.empty()) { order_by_ = key_column_; }
+    if (order_by_ != key_column_) {
+      throw std::invalid_argument(
+          "PsqlReader::open_cursor(): rows must be ordered by the "
+          "reconnect key column " + key_column_ + ". ");
+    }
   }
-  reset_pgresult(&res_);
 
-  // close transaction
-  res_ = PQexec(conn_, "END");
-  if (PQresultStatus(res_) != PGRES_COMMAND_OK) {
+  // continue after the rows that were already fetched
+  std::string where_clause = where_clause_;
+  std::vector<std::string> params = params_;
+  long limit = limit_;
+  if (n_fetched_ > 0) {
+    if (!where_clause.empty()) { where_clause = "(" + where_clause + ")"; }
+    append_predicate(where_clause, params, key_column_ + " >", last_key_);
+    if (limit >= 0) { limit -= n_fetched_; }
+  }
+
+  // assemble query statement
+  std::string query_stmt;
+  for (const auto &col : colnames_) { query_stmt += col + ","; }
+  query_stmt.pop_back();
+  query_stmt = "SELECT " + query_stmt + " FROM " + table_name_;
+  if (!where_clause.empty()) { query_stmt += " WHERE " + where_clause; }
+  if (!order_by_.empty()) { query_stmt += " ORDER BY " + order_by_; }
+  if (limit >= 0) { query_stmt += " LIMIT " + std::to_string(limit); }
+
+  // bound parameters are passed as text; the server infers their types. 
+  std::vector<const char*> param_values;
+  for (const auto &p : params) { param_values.push_back(p.c_str()); }
+
+  // declare cursor
+  PGresult *res = PQexecParams(reader_.conn_,
+     ("DECLARE " + cursor_name_ + " CURSOR FOR " + query_stmt).c_str(), 
+     param_values.size(), nullptr, 
+     param_values.empty() ? nullptr : param_values.data(), 
+     nullptr, nullptr, 0);
+  if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+    reset_pgresult(&res);
     throw std::runtime_error(
-        std::string("END command failed: ") + PQerrorMessage(conn_));
+        std::string("DECLARE CURSOR failed: ")
+        + PQerrorMessage(reader_.conn_));
   }
-  reset_pgresult(&res_);
+  reset_pgresult(&res);
 
 }
 
-bool PsqlReader::next() {
+void PsqlCursor::redeclare() { declare(key_column_); }
+
+bool PsqlCursor::next() {
 
   // non-empty buffer
   if (curr_idx_ != curr_max_) {
@@ -115,14 +320,19 @@ bool PsqlReader::next() {
   } else {
 
     reset_pgresult(&qres_);
+    fetch_bytes_ = 0;
 
     // empty store
-    if (curr_max_ != max_rows_) {  return false; }
+    if (curr_max_ != last_fetch_rows_) {  return false; }
 
     // fetch records from store and set the buffer state to 
     // indicate the (possible) availability of new records 
-    qres_ = PQexec(conn_, ("FETCH FORWARD " 
-         + std::to_string(max_rows_) + " in myportal").c_str());
+    for (int n_retries = 0; !fetch(); ++n_retries) {
+      std::string msg = PQerrorMessage(reader_.conn_);
+      reset_pgresult(&qres_);
+      reader_.recover(n_retries, msg);
+    }
+
     curr_max_ = PQntuples(qres_);
     curr_idx_ = 0;
 
@@ -131,3 +341,73 @@ bool PsqlReader::next() {
   }
 }
 
+// issue a FETCH on this cursor. returns false if it failed.
+bool PsqlCursor::fetch() {
+
+  PGconn *conn = reader_.conn_;
+  if (!conn || PQstatus(conn) != CONNECTION_OK) { return false; }
+
+  last_fetch_rows_ = fetch_rows_;
+  auto start = std::chrono::steady_clock::now();
+  qres_ = PQexec(conn, ("FETCH FORWARD "
+       + std::to_string(fetch_rows_) + " IN " + cursor_name_).c_str());
+  if (PQresultStatus(qres_) != PGRES_TUPLES_OK) { return false; }
+  std::chrono::duration<double> elapsed = 
+    std::chrono::steady_clock::now() - start;
+
+  // remember the position in case the cursor must be redeclared
+  size_t n = PQntuples(qres_);
+  n_fetched_ += n;
+  if (n > 0 && !key_column_.empty()) {
+    last_key_ = PQgetvalue(qres_, n-1, name2idx_.at(key_column_));
+  }
+
+  // size of the result: the text of every value plus, as libpq lays it 
+  // out, a length, a pointer and a terminator per value and a pointer 
+  // per row. 
+  size_t text_bytes = 0;
+  int n_fields = PQnfields(qres_);
+  for (size_t i = 0; i < n; ++i) {
+    for (int j = 0; j < n_fields; ++j) { 
+      text_bytes += PQgetlength(qres_, i, j); 
+    }
+  }
+  fetch_bytes_ = text_bytes + 
+    n * (n_fields * (sizeof(int) + sizeof(char*) + 1) + sizeof(void*));
+
+  if (reader_.target_bytes_ > 0) { 
+    adapt_fetch_size(elapsed.count(), text_bytes); 
+  }
+
+  return true;
+}
+
+// pick the size of the next fetch from the size and latency of the 
+// last one, which took `bytes` of row text. 
+void PsqlCursor::adapt_fetch_size(double seconds, size_t bytes) {
+
+  size_t n = PQntuples(qres_);
+  if (n == 0 || n < fetch_rows_) { return; }
+
+  // exponential moving averages. the first fetch sets them outright. 
+  const double alpha = 0.5;
+  double b = double(bytes) / n, t = seconds / n;
+  if (bytes_per_row_ == 0) { 
+    bytes_per_row_ = b; seconds_per_row_ = t; 
+  } else {
+    bytes_per_row_ = alpha * b + (1 - alpha) * bytes_per_row_;
+    seconds_per_row_ = alpha * t + (1 - alpha) * seconds_per_row_;
+  }
+
+  double rows = reader_.target_bytes_ / std::max(bytes_per_row_, 1.0);
+  if (seconds_per_row_ > 0) {
+    rows = std::min(rows, reader_.target_seconds_ / seconds_per_row_);
+  }
+  rows = std::min(rows, 2.0 * fetch_rows_);
+  rows = std::max(rows, 0.5 * fetch_rows_);
+
+  // the cap goes last so that no other limit can raise the fetch past it
+  rows = std::min(rows, reader_.max_bytes_ / std::max(bytes_per_row_, 1.0));
+
+  fetch_rows_ = std::max<size_t>(1, rows);
+}
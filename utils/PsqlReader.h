@@ -3,14 +3,134 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <memory>
 #include <unordered_map>
 
 #include <libpq-fe.h>
 
+class PsqlReader;
+
+// class that buffers the rows of one named cursor opened by PsqlReader.
+// each cursor fetches and caches its rows independently of the other
+// cursors on the same connection. obtain one with PsqlReader::cursor().
+class PsqlCursor {
+
+  friend class PsqlReader;
+
+  public: 
+    ~PsqlCursor();
+
+    // fetch the next available row. returns false if no new 
+    // rows are available. throws if a fetch fails and cannot be 
+    // recovered; a failed fetch is never mistaken for end of data. 
+    bool next();
+
+    // extract the contents in text form in the column `colname`. 
+    const std::string& get(const std::string &colname) const;
+
+    // same as above, but for the column with index `col`; see 
+    // column_index(). saves a lookup by name for every value read. 
+    const std::string& get(size_t col) const;
+
+    // index of the column `colname`, in the order it was selected. 
+    size_t column_index(const std::string &colname) const;
+
+    // name of the cursor.
+    const std::string& name() const { return cursor_name_; }
+
+    // number of rows requested by the next fetch. fixed unless 
+    // PsqlReader::enable_adaptive_fetch() was called. 
+    size_t fetch_size() const { return fetch_rows_; }
+
+    // estimated bytes held by the rows of the last fetch, until they 
+    // have all been read. 
+    size_t fetch_bytes() const { return fetch_bytes_; }
+
+  private:
+    PsqlCursor(PsqlReader &reader,
+               const std::string &cursor_name,
+               const std::string &table_name,
+               const std::vector<std::string> &colnames,
+               const std::string &where_clause,
+               const std::vector<std::string> &params,
+               const std::string &order_by,
+               long limit, size_t max_rows);
+
+    void declare(const std::string &key_column);
+    void redeclare();
+    bool fetch();
+    void adapt_fetch_size(double seconds, size_t bytes);
+
+  private:
+    PsqlReader &reader_;
+    PGresult *qres_;
+
+    std::string cursor_name_;
+
+    // query specification. kept to redeclare the cursor on reconnect. 
+    std::string table_name_;
+    std::vector<std::string> colnames_;
+    std::string where_clause_;
+    std::vector<std::string> params_;
+    std::string order_by_;
+    long limit_;
+
+    // reconnect state. `last_key_` is the key of the last row 
+    // fetched from the server, and `n_fetched_` the number of rows
+    // fetched so far. buffered rows are never fetched twice.
+    std::string key_column_;
+    std::string last_key_;
+    size_t n_fetched_;
+
+    size_t curr_idx_, curr_max_;
+    size_t max_rows_;
+
+    // rows to request by the next fetch and requested by the last one. 
+    // for adaptive fetching, the smoothed bytes and seconds per row 
+    // seen so far. 
+    size_t fetch_rows_, last_fetch_rows_;
+    double bytes_per_row_, seconds_per_row_;
+    size_t fetch_bytes_;
+
+    std::unordered_map<std::string, size_t> name2idx_;
+    std::vector<std::string> cache_;
+};
+
+
 // class that reads a set of columns from a table in 
 // some database and delivers it memory. 
-// i.e. performs 'SELECT col1,...,colN FROM table_name'
+// i.e. performs 'SELECT col1,...,colN FROM table_name', optionally 
+// restricted by 'WHERE ... ORDER BY ... LIMIT ...'. 
+//
+// several named cursors may be open at once. they share the connection
+// and a single transaction, which begins when the first cursor is opened
+// and ends when the last one is closed. next(), get() and close_cursor()
+// without a cursor name act on the current cursor: the most recently 
+// opened one, or, once that is closed, one of those still open.
+//
+// example: join two tables on eid on the client. both cursors are 
+// ordered by eid, and whichever is behind is advanced, so rows missing 
+// from either table are skipped instead of pairing up the wrong eids. 
+//
+//   psql.open_cursor("mcgraph", { "eid", ... }, "", {}, "eid", -1,
+//                    5000, "mc_portal");
+//   psql.open_cursor("recograph", { "eid", ... }, "", {}, "eid", -1,
+//                    5000, "reco_portal");
+//   PsqlCursor &mc = psql.cursor("mc_portal");
+//   PsqlCursor &reco = psql.cursor("reco_portal");
+//   bool more = mc.next() && reco.next();
+//   while (more) {
+//     int mc_eid = std::stoi(mc.get("eid"));
+//     int reco_eid = std::stoi(reco.get("eid"));
+//     if (mc_eid < reco_eid) { more = mc.next(); }
+//     else if (reco_eid < mc_eid) { more = reco.next(); }
+//     else { ...; more = mc.next() && reco.next(); }
+//   }
 class PsqlReader {
+
+  friend class PsqlCursor;
+
   public: 
 
     PsqlReader();
@@ -23,63 +143,149 @@ class PsqlReader {
     // close the database connecion. 
     void close_connection();
 
+    // recover from failed fetches by reconnecting and repositioning the 
+    // cursors. must be called before open_cursor().
+    // + key_column: a selected column that uniquely orders the rows, 
+    //               e.g. "eid". cursors are ordered by it, and after a
+    //               reconnect they resume with rows past the last key read.
+    // + max_retries: number of consecutive reconnect attempts before 
+    //                giving up and throwing. attempts are 1, 2, 4, ... 
+    //                seconds apart, and at most 60 seconds. 
+    void enable_reconnect(const std::string &key_column, int max_retries=3);
+
+    // let the cursors opened afterwards tune their fetch size. the 
+    // `max_rows` given to open_cursor() is the first fetch size; after 
+    // each fetch, the size is moved toward the number of rows that 
+    // would take `target_bytes` of text and `target_seconds` to fetch, 
+    // whichever is fewer. it at most doubles or halves per fetch, except 
+    // that it never goes past `max_bytes`. the first fetch is not 
+    // covered, since the row size is not known until it returns; pick 
+    // `max_rows` small enough for it. 
+    void enable_adaptive_fetch(size_t target_bytes, 
+                               double target_seconds = 1.0, 
+                               size_t max_bytes = 256 << 20);
+
     // open a cursor to read from a table in the current database connection. 
     // + table_name: table to read from.
     // + colnames: vector of column names to read. 
     // + max_rows: maximum number of rows per fetch. 
-    // + cursor_name: name of the cursor. 
+    // + cursor_name: name of the cursor. must not already be open.
     void open_cursor(const std::string &table_name, 
                      const std::vector<std::string> &colnames,
                      size_t max_rows=10000, 
                      const std::string &cursor_name = "myportal");
 
-    // close the cursor
+    // same as above, but only select rows satisfying a predicate. 
+    // + where_clause: sql predicate following WHERE. it may refer to 
+    //                 bound parameters $1,...,$N. empty for no predicate. 
+    // + params: text values of the bound parameters $1,...,$N. 
+    // + order_by: sql following ORDER BY. empty for no ordering. 
+    // + limit: maximum number of rows to select. negative for no limit. 
+    //
+    // example: read the eid shard [1000, 2000) in eid order
+    //
+    //   psql.open_cursor("framework_ntuples", { "eid", "mclen" }, 
+    //                    "eid >= $1 AND eid < $2", { "1000", "2000" }, 
+    //                    "eid");
+    void open_cursor(const std::string &table_name, 
+                     const std::vector<std::string> &colnames,
+                     const std::string &where_clause, 
+                     const std::vector<std::string> &params = {},
+                     const std::string &order_by = "",
+                     long limit = -1,
+                     size_t max_rows=10000, 
+                     const std::string &cursor_name = "myportal");
+
+    // access an open cursor by name.
+    PsqlCursor& cursor(const std::string &cursor_name);
+
+    // close the current cursor
     void close_cursor();
 
-    // fetch the next available row. returns false if no new 
-    // rows were able to be fetched. 
+    // close the cursor `cursor_name`
+    void close_cursor(const std::string &cursor_name);
+
+    // fetch the next available row of the current cursor.
+    // returns false if no new rows are available.
     bool next();
 
-    // extract the contents in text form in the column `colname`. 
+    // extract the contents in text form in the column `colname`
+    // of the current cursor.
     const std::string& get(const std::string &colname) const;
 
+    // same as above, but for the column with index `col`. 
+    const std::string& get(size_t col) const;
+
+    // index of the column `colname` in the current cursor. 
+    size_t column_index(const std::string &colname) const;
+
+    // estimated bytes held by the last fetch of the current cursor; 0 if 
+    // no cursor is open. see PsqlCursor::fetch_bytes(). 
+    size_t fetch_bytes() const;
+
   private:
-    void reset_pgresult(PGresult **res);
-    void reset_pgconn(PGconn **conn);
+    void connect();
+    void exec_command(const std::string &command);
+    void recover(int n_retries, const std::string &msg);
 
   private:
     PGconn *conn_;
-    PGresult *res_;
-    PGresult *qres_;
 
-    std::string cursor_name_;
+    std::string conninfo_;
 
-    size_t curr_idx_, curr_max_;
-    size_t max_rows_;
+    std::string key_column_;
+    int max_retries_;
 
-    std::unordered_map<std::string, size_t> name2idx_;
-    std::vector<std::string> cache_;
+    // adaptive fetch targets. disabled if target_bytes_ is 0. 
+    size_t target_bytes_;
+    double target_seconds_;
+    size_t max_bytes_;
+
+    std::map<std::string, std::unique_ptr<PsqlCursor>> cursors_;
+    PsqlCursor *current_;
 };
 
+// helper to assemble the predicates accepted by PsqlReader::open_cursor(). 
+// appends `expr $k` to the conjunction in `where_clause` and binds `value` 
+// to the new parameter $k. 
+//
+// example: append_predicate(where_clause, params, "eid >=", "1000");
+inline void append_predicate(
+    std::string &where_clause, std::vector<std::string> &params, 
+    const std::string &expr, const std::string &value) {
+  params.push_back(value);
+  if (!where_clause.empty()) { where_clause += " AND "; }
+  where_clause += expr + " $" + std::to_string(params.size());
+}
 
-inline void PsqlReader::close_connection() { 
-  reset_pgconn(&conn_); 
+inline const std::string& PsqlCursor::get(const std::string &colname) const {
+  return cache_[name2idx_.at(colname)];
 }
 
+inline const std::string& PsqlCursor::get(size_t col) const {
+  return cache_[col];
+}
+
+inline size_t PsqlCursor::column_index(const std::string &colname) const {
+  return name2idx_.at(colname);
+}
+
+inline bool PsqlReader::next() { return current_->next(); }
+
 inline const std::string& PsqlReader::get(const std::string &colname) const {
-  return cache_[name2idx_.at(colname)];
+  return current_->get(colname);
+}
+
+inline const std::string& PsqlReader::get(size_t col) const {
+  return current_->get(col);
 }
 
-// use this to reset PGconn* objects
-inline void PsqlReader::reset_pgconn(PGconn **conn) {
-  if (*conn) { PQfinish(*conn); }
-  *conn = nullptr;
+inline size_t PsqlReader::column_index(const std::string &colname) const {
+  return current_->column_index(colname);
 }
 
-// use this to reset PGresult* objects
-inline void PsqlReader::reset_pgresult(PGresult **res) {
-  if (*res) { PQclear(*res); }
-  *res = nullptr;
+inline size_t PsqlReader::fetch_bytes() const {
+  return current_ ? current_->fetch_bytes() : 0;
 }
 
 #endif
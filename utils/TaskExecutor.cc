@@ -0,0 +1,210 @@
+#include <stdexcept>
+#include <algorithm>
+
+#include "TaskExecutor.h"
+
+namespace {
+
+// executor and worker index of the calling thread.
+thread_local const TaskExecutor *this_executor = nullptr;
+thread_local int this_worker = -1;
+
+}
+
+TaskExecutor::TaskExecutor(int n_workers)
+  : n_queued_(0), next_worker_(0), stopping_(false) {
+
+  if (n_workers < 0) {
+    throw std::invalid_argument(
+        "TaskExecutor::TaskExecutor(): n_workers must not be negative. ");
+  }
+  if (n_workers == 0) {
+    n_workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (int w = 0; w < n_workers; ++w) {
+    workers_.emplace_back(new Worker);
+  }
+  for (int w = 0; w < n_workers; ++w) {
+    threads_.emplace_back(&TaskExecutor::work, this, w);
+  }
+}
+
+TaskExecutor::~TaskExecutor() {
+  try { wait(); } catch (...) {}
+  {
+    std::lock_guard<std::mutex> lock(idle_mtx_);
+    stopping_ = true;
+  }
+  idle_cv_.notify_all();
+  for (auto &t : threads_) { t.join(); }
+}
+
+int TaskExecutor::current_worker() const {
+  return this_executor == this ? this_worker : -1;
+}
+
+void TaskExecutor::submit(Task task) { push(std::move(task), submitted_); }
+
+void TaskExecutor::wait() {
+  wait_until(submitted_, [this] { return submitted_.pending == 0; });
+  rethrow(submitted_);
+}
+
+void TaskExecutor::parallel_for(
+    size_t n, size_t grain, const std::function<void(int, size_t)> &f) {
+  parallel_for_ordered(n, grain, f, std::function<void(size_t)>());
+}
+
+void TaskExecutor::parallel_for_ordered(
+    size_t n, size_t grain,
+    const std::function<void(int, size_t)> &f,
+    const std::function<void(size_t)> &complete) {
+
+  if (n == 0) { return; }
+  grain = std::max<size_t>(grain, 1);
+  size_t n_chunks = (n + grain - 1) / grain;
+
+  // chunk c covers [c*grain, min((c+1)*grain, n)). done[c] is written
+  // with the mutex of the group held.
+  Group group;
+  std::vector<char> done(n_chunks, 0);
+  for (size_t c = 0; c < n_chunks; ++c) {
+    push([&, c] (int worker) {
+      struct MarkDone {
+        Group &group; std::vector<char> &done; size_t c;
+        ~MarkDone() { std::lock_guard<std::mutex> lock(group.mtx); done[c] = 1; }
+      } mark_done { group, done, c };
+      size_t end = std::min((c+1) * grain, n);
+      for (size_t i = c * grain; i < end && !group.failed; ++i) { f(worker, i); }
+    }, group);
+  }
+
+  // hand out completions chunk by chunk. once a task failed, wait for
+  // the rest to stop and rethrow.
+  try {
+    if (complete) {
+      for (size_t c = 0; c < n_chunks && !group.failed; ++c) {
+        wait_until(group, [&] { return done[c] || group.failed; });
+        if (group.failed) { break; }
+        size_t end = std::min((c+1) * grain, n);
+        for (size_t i = c * grain; i < end; ++i) { complete(i); }
+      }
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(group.mtx);
+    if (!group.error) { group.error = std::current_exception(); }
+    group.failed = true;
+  }
+
+  // the tasks refer to locals of this frame
+  wait_until(group, [&] { return group.pending == 0; });
+  rethrow(group);
+}
+
+void TaskExecutor::push(Task task, Group &group) {
+
+  ++group.pending;
+
+  // tasks queued by a worker stay with it; the others are dealt out
+  int w = current_worker();
+  if (w < 0) { w = next_worker_++ % workers_.size(); }
+  {
+    std::lock_guard<std::mutex> lock(workers_[w]->mtx);
+    workers_[w]->jobs.push_back(Job { std::move(task), &group });
+  }
+  ++n_queued_;
+
+  // taking the lock orders this against a worker about to sleep
+  { std::lock_guard<std::mutex> lock(idle_mtx_); }
+  idle_cv_.notify_one();
+}
+
+// take the newest job of `worker`, or else the oldest job of the next
+// worker that has any.
+bool TaskExecutor::pop(int worker, Job &job) {
+
+  size_t n = workers_.size();
+  for (size_t k = 0; k < n; ++k) {
+    Worker &victim = *workers_[(worker + k) % n];
+    std::lock_guard<std::mutex> lock(victim.mtx);
+    if (victim.jobs.empty()) { continue; }
+    if (k == 0) {
+      job = std::move(victim.jobs.back());
+      victim.jobs.pop_back();
+    } else {
+      job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+    }
+    --n_queued_;
+    return true;
+  }
+  return false;
+}
+
+void TaskExecutor::run(int worker, Job &job) {
+
+  Group &group = *job.group;
+  if (!group.failed) {
+    try {
+      job.task(worker);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(group.mtx);
+      if (!group.error) { group.error = std::current_exception(); }
+      group.failed = true;
+    }
+  }
+  job.task = nullptr;
+
+  // notify with the lock held: the group may be destroyed as soon as its
+  // waiter sees the count drop.
+  std::lock_guard<std::mutex> lock(group.mtx);
+  --group.pending;
+  group.cv.notify_all();
+}
+
+void TaskExecutor::work(int worker) {
+
+  this_executor = this;
+  this_worker = worker;
+
+  Job job;
+  while (true) {
+    if (pop(worker, job)) { run(worker, job); continue; }
+
+    std::unique_lock<std::mutex> lock(idle_mtx_);
+    if (stopping_ && n_queued_ == 0) { return; }
+    idle_cv_.wait(lock, [this] { return stopping_ || n_queued_ > 0; });
+  }
+}
+
+void TaskExecutor::wait_until(Group &group, const std::function<bool()> &done) {
+
+  // a worker must not block: the tasks it waits for may sit in its own
+  // deque. it runs tasks until `done` holds instead.
+  int w = current_worker();
+  if (w >= 0) {
+    Job job;
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lock(group.mtx);
+        if (done()) { return; }
+      }
+      if (pop(w, job)) { run(w, job); } else { std::this_thread::yield(); }
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(group.mtx);
+  group.cv.wait(lock, done);
+}
+
+// rethrow the first exception of `group` and make it reusable.
+void TaskExecutor::rethrow(Group &group) {
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(group.mtx);
+    std::swap(error, group.error);
+    group.failed = false;
+  }
+  if (error) { std::rethrow_exception(error); }
+}
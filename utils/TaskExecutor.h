@@ -0,0 +1,126 @@
+#ifndef _TASK_EXECUTOR_H_
+#define _TASK_EXECUTOR_H_
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+// class that runs tasks on a fixed set of worker threads.
+//
+// each worker owns a deque of tasks. it takes its own tasks from the
+// back, newest first, and when it runs out steals the oldest task from
+// the front of another worker's deque. tasks submitted from outside are
+// dealt round robin over the deques; tasks submitted by a task go to the
+// deque of the worker running it.
+//
+// every task is told the index of the worker running it, in
+// [0, n_workers()), so that per-worker state such as a TruthMatcher can
+// be kept in a vector indexed by worker.
+//
+// usage:
+//
+//    TaskExecutor executor(n_threads);
+//    std::vector<TruthMatcher> matchers(executor.n_workers(), ...);
+//    executor.parallel_for_ordered(records.size(), 1,
+//        [&] (int worker, size_t i) { ...match records[i] with matchers[worker]... },
+//        [&] (size_t i) { ...write the result of records[i]... });
+//
+// the first exception thrown by a task is rethrown by the call waiting
+// for it, and the not yet started tasks of that call are skipped.
+class TaskExecutor {
+
+  public:
+    using Task = std::function<void(int)>;
+
+    // start `n_workers` threads. 0 starts one per core.
+    TaskExecutor(int n_workers = 0);
+
+    // wait for the submitted tasks, then stop the workers. exceptions
+    // of tasks nobody waited for are dropped.
+    ~TaskExecutor();
+
+    TaskExecutor(const TaskExecutor&) = delete;
+    TaskExecutor& operator=(const TaskExecutor&) = delete;
+
+    int n_workers() const { return workers_.size(); }
+
+    // index of the worker of this executor running the calling thread,
+    // -1 if the calling thread is not one of them.
+    int current_worker() const;
+
+    // queue `task`. wait() waits for it.
+    void submit(Task task);
+
+    // wait for every task passed to submit() so far, then rethrow the
+    // first exception any of them threw.
+    void wait();
+
+    // call f(worker, i) for every i in [0, n) and wait for all of them.
+    // indices are handed out in chunks of `grain`.
+    void parallel_for(size_t n, size_t grain,
+                      const std::function<void(int, size_t)> &f);
+
+    // as parallel_for(), but also call complete(i) on the calling
+    // thread, in increasing order of i, as soon as f(worker, j) has
+    // returned for every j <= i. writers can thus emit results in input
+    // order while later ones are still being computed.
+    void parallel_for_ordered(size_t n, size_t grain,
+                              const std::function<void(int, size_t)> &f,
+                              const std::function<void(size_t)> &complete);
+
+    // the calls above may also be made from within a task; the waiting
+    // worker runs other tasks in the meantime.
+
+  private:
+    // tasks waited for together.
+    struct Group {
+      std::atomic<size_t> pending;
+      std::atomic<bool> failed;
+      std::exception_ptr error;
+      std::mutex mtx;
+      std::condition_variable cv;
+
+      Group() : pending(0), failed(false) {}
+    };
+
+    struct Job {
+      Task task;
+      Group *group;
+    };
+
+    struct Worker {
+      std::deque<Job> jobs;
+      std::mutex mtx;
+    };
+
+    void push(Task task, Group &group);
+    bool pop(int worker, Job &job);
+    void run(int worker, Job &job);
+    void work(int worker);
+
+    // wait until `done` holds. `done` is evaluated with the mutex of
+    // `group` held.
+    void wait_until(Group &group, const std::function<bool()> &done);
+    void rethrow(Group &group);
+
+  private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::atomic<size_t> n_queued_;
+    std::atomic<size_t> next_worker_;
+
+    std::mutex idle_mtx_;
+    std::condition_variable idle_cv_;
+    bool stopping_;
+
+    Group submitted_;
+};
+
+#endif
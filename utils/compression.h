@@ -0,0 +1,62 @@
+#ifndef _COMPRESSION_H_
+#define _COMPRESSION_H_
+
+#include <string>
+#include <stdexcept>
+
+#include <boost/version.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#if BOOST_VERSION >= 107000
+#include <boost/iostreams/filter/zstd.hpp>
+#endif
+
+// transparent compression of text files, selected by file name suffix:
+// + .gz: gzip.
+// + .zst: zstd. requires boost 1.70 or later built with zstd support,
+//   as set in the makefiles; older boost throws when the file is opened.
+// any other suffix means no compression.
+
+inline bool has_suffix(const std::string &fname, const std::string &suffix) {
+  return fname.size() >= suffix.size() &&
+         fname.compare(fname.size()-suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// true if `fname` names a compressed file.
+inline bool is_compressed_fname(const std::string &fname) {
+  return has_suffix(fname, ".gz") || has_suffix(fname, ".zst");
+}
+
+// push the compressor implied by `fname` onto `os`. the file sink
+// must be pushed afterwards.
+inline void push_compressor(
+    boost::iostreams::filtering_ostream &os, const std::string &fname) {
+  if (has_suffix(fname, ".gz")) {
+    os.push(boost::iostreams::gzip_compressor());
+  } else if (has_suffix(fname, ".zst")) {
+#if BOOST_VERSION >= 107000
+    os.push(boost::iostreams::zstd_compressor());
+#else
+    throw std::runtime_error(
+        "push_compressor(): zstd requires boost 1.70 or later. ");
+#endif
+  }
+}
+
+// push the decompressor implied by `fname` onto `is`. the file source
+// must be pushed afterwards.
+inline void push_decompressor(
+    boost::iostreams::filtering_istream &is, const std::string &fname) {
+  if (has_suffix(fname, ".gz")) {
+    is.push(boost::iostreams::gzip_decompressor());
+  } else if (has_suffix(fname, ".zst")) {
+#if BOOST_VERSION >= 107000
+    is.push(boost::iostreams::zstd_decompressor());
+#else
+    throw std::runtime_error(
+        "push_decompressor(): zstd requires boost 1.70 or later. ");
+#endif
+  }
+}
+
+#endif
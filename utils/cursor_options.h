@@ -0,0 +1,96 @@
+#ifndef _CURSOR_OPTIONS_H_
+#define _CURSOR_OPTIONS_H_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <boost/program_options.hpp>
+
+#include "PsqlReader.h"
+
+// program options shared by the programs that read an event table
+// through a PsqlReader cursor:
+//
+// + cursor_fetch_size: rows per cursor fetch, and the first fetch size
+//                      when adaptive fetching is on.
+// + adaptive_fetch_mb, adaptive_fetch_ms, adaptive_fetch_max_mb:
+//     tune the fetch size to the table instead. starting from
+//     cursor_fetch_size, each fetch is resized toward adaptive_fetch_mb
+//     MiB of row text and adaptive_fetch_ms milliseconds, whichever is
+//     fewer rows, and never past adaptive_fetch_max_mb. the first fetch
+//     is not capped, as the row size is not known yet.
+// + min_eid, max_eid: optional eid shard [min_eid, max_eid). the range
+//                     is applied in the cursor query, so only the
+//                     selected rows are read.
+// + reconnect_retries: reconnect attempts after a failed fetch. the
+//                      cursor is reopened after the last eid read, which
+//                      requires reading in eid order.
+
+// add the options above to `config`.
+inline void add_cursor_options(
+    boost::program_options::options_description &config) {
+  namespace po = boost::program_options;
+  config.add_options()
+      ("cursor_fetch_size", po::value<int>()->default_value(5000),
+           "number of rows per cursor fetch. ")
+      ("adaptive_fetch_mb", po::value<int>()->default_value(0),
+           "if positive, tune the fetch size toward this many MiB per "
+           "fetch, starting from cursor_fetch_size. 0 disables. ")
+      ("adaptive_fetch_ms", po::value<int>()->default_value(1000),
+           "adaptive fetching also keeps fetches near this latency. ")
+      ("adaptive_fetch_max_mb", po::value<int>()->default_value(256),
+           "adaptive fetching never fetches more MiB than this, "
+           "except for the first fetch. ")
+      ("min_eid", po::value<int>(),
+           "if set, only read records with eid >= min_eid. ")
+      ("max_eid", po::value<int>(),
+           "if set, only read records with eid < max_eid. ")
+      ("reconnect_retries", po::value<int>()->default_value(0),
+           "number of reconnect attempts after a failed fetch. the "
+           "cursor resumes after the last eid read. 0 disables. ")
+  ;
+}
+
+// append the eid shard requested in `vm` to the predicates of the
+// cursor query.
+inline void append_eid_range(
+    const boost::program_options::variables_map &vm,
+    std::string &where_clause, std::vector<std::string> &params) {
+  if (vm.count("min_eid")) {
+    append_predicate(where_clause, params, "eid >=",
+                     std::to_string(vm["min_eid"].as<int>()));
+  }
+  if (vm.count("max_eid")) {
+    append_predicate(where_clause, params, "eid <",
+                     std::to_string(vm["max_eid"].as<int>()));
+  }
+}
+
+// enable reconnecting and adaptive fetching as requested in `vm` for
+// the cursors that `psql` opens afterwards. those cursors must select
+// eid, so open any other cursor, e.g. on a state table, beforehand.
+// a positive `max_fetch_bytes` further caps adaptive fetches.
+inline void configure_cursor(
+    PsqlReader &psql, const boost::program_options::variables_map &vm,
+    size_t max_fetch_bytes = 0) {
+
+  // survive transient server failures by reopening the cursor
+  int reconnect_retries = vm["reconnect_retries"].as<int>();
+  if (reconnect_retries > 0) {
+    psql.enable_reconnect("eid", reconnect_retries);
+  }
+
+  // let the cursor tune its fetch size to the width of the rows
+  if (vm["adaptive_fetch_mb"].as<int>() > 0) {
+    size_t max_bytes = size_t(vm["adaptive_fetch_max_mb"].as<int>()) << 20;
+    if (max_fetch_bytes > 0) {
+      max_bytes = std::min(max_bytes, max_fetch_bytes);
+    }
+    psql.enable_adaptive_fetch(
+        size_t(vm["adaptive_fetch_mb"].as<int>()) << 20,
+        vm["adaptive_fetch_ms"].as<int>() / 1000.0, max_bytes);
+  }
+}
+
+#endif
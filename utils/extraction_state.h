@@ -0,0 +1,41 @@
+#ifndef _EXTRACTION_STATE_H_
+#define _EXTRACTION_STATE_H_
+
+#include <string>
+
+#include "PsqlReader.h"
+#include "pgstring_convert.h"
+
+// bookkeeping for incremental extraction.
+//
+// a state table records, for each output table, the largest eid that
+// has already been extracted and loaded (the high-water eid):
+//
+//   CREATE TABLE extraction_state (
+//     state_key text PRIMARY KEY,
+//     max_eid integer
+//   );
+//
+// the populate scripts advance `max_eid` in the same transaction that
+// loads the extracted rows. the extractors read it back to select only
+// events past the high-water eid.
+
+// read the high-water eid recorded under `state_key` in `state_table`.
+// returns false if nothing has been recorded yet.
+inline bool read_high_water_eid(
+    PsqlReader &psql,
+    const std::string &state_table, const std::string &state_key,
+    int &max_eid) {
+
+  psql.open_cursor(state_table, { "max_eid" },
+      "state_key = $1 AND max_eid IS NOT NULL", { state_key }, "", 1, 1);
+
+  bool recorded = psql.next();
+  if (recorded) { pgstring_convert(psql.get("max_eid"), max_eid); }
+
+  psql.close_cursor();
+
+  return recorded;
+}
+
+#endif
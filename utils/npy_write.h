@@ -0,0 +1,99 @@
+#ifndef _NPY_WRITE_H_
+#define _NPY_WRITE_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+
+// functions that write arrays in the numpy .npy format (version 1.0),
+// which numpy.load() can memory map with mmap_mode='r'.
+//
+// data is written in host byte order and described as little endian,
+// so these must only be used on little endian hosts.
+
+// helper trait class and specializations
+template <typename T>
+class npy_dtype_traits;
+
+template <>
+class npy_dtype_traits<uint8_t> {
+  public:
+    static const char* descr() { return "|u1"; }
+};
+
+template <>
+class npy_dtype_traits<int8_t> {
+  public:
+    static const char* descr() { return "|i1"; }
+};
+
+template <>
+class npy_dtype_traits<int32_t> {
+  public:
+    static const char* descr() { return "<i4"; }
+};
+
+template <>
+class npy_dtype_traits<int64_t> {
+  public:
+    static const char* descr() { return "<i8"; }
+};
+
+template <>
+class npy_dtype_traits<float> {
+  public:
+    static const char* descr() { return "<f4"; }
+};
+
+// write `data` as a C ordered array of shape `shape` to `fname`.
+template <typename T>
+void npy_write(const std::string &fname,
+               const std::vector<T> &data,
+               const std::vector<size_t> &shape) {
+
+  size_t n = 1;
+  for (auto d : shape) { n *= d; }
+  if (n != data.size()) {
+    throw std::invalid_argument(
+        "npy_write(): shape does not match data.size(). ");
+  }
+
+  // header dictionary. a 1-tuple needs a trailing comma.
+  std::string header = "{'descr': '";
+  header += npy_dtype_traits<T>::descr();
+  header += "', 'fortran_order': False, 'shape': (";
+  for (size_t i = 0; i < shape.size(); ++i) {
+    header += std::to_string(shape[i]);
+    if (i+1 < shape.size() || shape.size() == 1) { header += ","; }
+    if (i+1 < shape.size()) { header += " "; }
+  }
+  header += "), }";
+
+  // the data must start at a multiple of 64 bytes:
+  // magic (6) + version (2) + header length (2) + header + '\n'.
+  size_t total = 10 + header.size() + 1;
+  header.append((64 - total % 64) % 64, ' ');
+  header += '\n';
+
+  std::ofstream fout(fname, std::ios::binary);
+  if (!fout.is_open()) {
+    throw std::runtime_error("npy_write(): cannot open " + fname + ". ");
+  }
+
+  uint16_t header_len = header.size();
+  fout.write("\x93NUMPY\x01\x00", 8);
+  fout.put(static_cast<char>(header_len & 0xff));
+  fout.put(static_cast<char>(header_len >> 8));
+  fout.write(header.data(), header.size());
+  fout.write(reinterpret_cast<const char*>(data.data()),
+             data.size() * sizeof(T));
+
+  fout.close();
+  if (!fout) {
+    throw std::runtime_error("npy_write(): cannot write " + fname + ". ");
+  }
+}
+
+#endif
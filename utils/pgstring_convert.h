@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
 #include <boost/tokenizer.hpp>
 
 // functions that convert between postgres text data 
@@ -59,6 +61,31 @@ void pgstring_convert(
             pgstring_conversion_traits<T>::convert);
 }
 
+// function that appends the elements of a postgres integer array in text 
+// form, e.g. "{1,2,3}", to `v`. returns the number of elements appended. 
+// unlike pgstring_convert(), `v` is not cleared and no temporary strings 
+// are created, so it suits decoding many arrays into one buffer. 
+inline size_t pgstring_append(const std::string &s, std::vector<int> &v) {
+
+  size_t n = v.size();
+
+  const char *p = s.c_str();
+  while (*p == '{') { ++p; }
+  while (*p != '\0' && *p != '}') {
+    char *end;
+    long e = std::strtol(p, &end, 10);
+    if (end == p) {
+      throw std::invalid_argument(
+          "pgstring_append(): malformed integer array " + s + ". ");
+    }
+    v.push_back(e);
+    p = end; 
+    if (*p == ',') { ++p; }
+  }
+
+  return v.size() - n;
+}
+
 // function that converts std::vector to postgres text data. 
 // NOTE: uses std::to_string(); this may not be what you want for float types. 
 template <typename T> 
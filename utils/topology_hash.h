@@ -0,0 +1,28 @@
+#ifndef _TOPOLOGY_HASH_H_
+#define _TOPOLOGY_HASH_H_
+
+#include <vector>
+#include <boost/functional/hash.hpp>
+
+// hash of a particle graph given as edge lists and per-vertex lund ids. 
+// any pair of index arrays that determines the edges, such as compressed 
+// daughter lists, works equally well. vertex indices are positional, so 
+// graphs extracted from the same decay topology by the same extractor 
+// hash equal. equal hashes do not guarantee equal graphs; compare the 
+// arrays to be certain. 
+inline size_t topology_hash(
+    int n_vertices, 
+    const std::vector<int> &from_vertices, 
+    const std::vector<int> &to_vertices, 
+    const std::vector<int> &lund_id) {
+
+  size_t seed = 0;
+  boost::hash_combine(seed, n_vertices);
+  boost::hash_combine(seed, from_vertices.size());
+  boost::hash_range(seed, from_vertices.begin(), from_vertices.end());
+  boost::hash_range(seed, to_vertices.begin(), to_vertices.end());
+  boost::hash_range(seed, lund_id.begin(), lund_id.end());
+  return seed;
+}
+
+#endif